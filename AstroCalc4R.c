@@ -20,58 +20,31 @@
 */
 
 #include "AstroCalc4R.h"
+#include "solar.h"
+#include "calendar.h"
 using namespace std;
 
 int isleap(int year)
 {
-	if ((year % 4 == 0 && year % 100 != 0) || year % 400 == 0)
-		return 1;
-	else
-		return 0;
+	return cal_is_leap(year);
 }
 
 int daymonth(int month, int year)
 {
-	int leap;
-
-	static int daytab[2][13] =
-	{
-		{0, 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31},
-		{0, 31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31}
-	};
-
-
-	leap = isleap(year);
-
-	return daytab[leap][month];
+	return cal_days_in_month(year, month);
 }
 
 double JulianDay(double xday,double xmonth,double xyear)
 {
-	int mm;
-	double xa, xb;
-	double jd;
-
-	/* Calculate Julian Day Starting at 4712 BC
-	** Method from "Astronomical Algorithms" P. 61
+	/* Julian Day Starting at 4712 BC, from the integer Julian day 
+	** number (noon) of the date and the fraction of the day
 	*/
+	int dd = (int) xday;
 
-	mm = (int) xmonth;
-
-	if (mm <= 2)
-	{
-		xmonth = xmonth + 12;
-		xyear = xyear - 1.0;
-	}
-
-	xa = floor(xyear / 100.0);
-	xb = 2.0 - xa + floor(xa / 4.0);
-
-	jd = floor(365.25 * (xyear + 4716.)) + floor(30.6001 * (xmonth + 1.0)) + xday + xb - 1524.5;
-
-	return jd;
+	return (double) julian_day_number((int) xyear, (int) xmonth, dd) - 0.5 + (xday - dd);
 }
-double EquationTime(double epsilon, double sl, double eeo, double sa)
+template <class M>
+static double equation_time(double epsilon, double sl, double eeo, double sa)
 {
 	/* Calculate Equation of Time
 	** "Astronomical Algoritms" Eq. 28.3
@@ -90,13 +63,13 @@ double EquationTime(double epsilon, double sl, double eeo, double sa)
 
 	xx = epsilon / 2.0;
 
-	yy = tan(xx) * tan(xx);
+	yy = M::tan(xx) * M::tan(xx);
 
 	yy2 = yy * yy / 2.0;
 
 	xx2 = 1.25 * eeo * eeo;
 
-	e = yy * sin(2.* sl) - 2.0 * eeo * sin(sa) + 4.0 * eeo * yy * sin(sa) * cos(2. * sl) - yy2 * sin(4. * sl) - xx2 * sin(2. * sa);
+	e = yy * M::sin(2.* sl) - 2.0 * eeo * M::sin(sa) + 4.0 * eeo * yy * M::sin(sa) * M::cos(2. * sl) - yy2 * M::sin(4. * sl) - xx2 * M::sin(2. * sa);
 
 	/* convert to degrees */
 
@@ -110,6 +83,11 @@ double EquationTime(double epsilon, double sl, double eeo, double sa)
 
 }
 
+double EquationTime(double epsilon, double sl, double eeo, double sa)
+{
+	return equation_time<libm_math>(epsilon, sl, eeo, sa);
+}
+
 /* 
 **  Calculate Photosynthetically Available Radiation (PAR - Watts / M2)
 **
@@ -126,7 +104,8 @@ double EquationTime(double epsilon, double sl, double eeo, double sa)
 **
 */
 
-double parcalc(double zenith)
+template <class M>
+static double par_calc(double zenith)
 {
 /*
 ** 
@@ -164,21 +143,26 @@ double parcalc(double zenith)
 		return 0.0;
 
 	zrad = zenith * XDEGRAD;
-	x1 = 1.4 / cos(zrad);
-	xx = exp(-0.002 * pow(x1,0.87));
-	x2 = 0.34 / cos(zrad);
-	xxx = exp(-0.052 * pow(x2,0.99));
+	x1 = 1.4 / M::cos(zrad);
+	xx = M::exp(-0.002 * M::pow(x1,0.87));
+	x2 = 0.34 / M::cos(zrad);
+	xxx = M::exp(-0.052 * M::pow(x2,0.99));
 	xa = 0.068 + 0.379 / 23.0;
 	xb = 1.0 - 0.05 * (0.117 + 0.493 / 23.0);
-	par = 531.2 * cos(zrad) * exp(-(xa) / cos(zrad)) / xb  * xx * xxx;
+	par = 531.2 * M::cos(zrad) * M::exp(-(xa) / M::cos(zrad)) / xb  * xx * xxx;
 
 	return par;		 
 }
 
+double parcalc(double zenith)
+{
+	return par_calc<libm_math>(zenith);
+}
 
-void AstroCalc4R(int *nrec, int *tzone, int *day,int *month,int *year, double *hhour,double *xlat,double *xlon, \
-				 double *noon,double *sunrise,double *sunset,double *azimuth,double *zenith, \
-				 double *eqtime,double *declin, double *daylength, double *par)
+
+template <class M>
+static inline void astro_point(int tzone, int day, int month, int year, double hhour, double xlat, double xlon,
+                               struct solar_output *out) noexcept
 { 
 
 /* 
@@ -187,7 +171,6 @@ void AstroCalc4R(int *nrec, int *tzone, int *day,int *month,int *year, double *h
     const double XDEGRAD=3.141592654 / 180.;
 
 	int dm;
-	double xd, xm, xy;
 	double jd;
 	double jc;
 	double xx;
@@ -210,27 +193,18 @@ void AstroCalc4R(int *nrec, int *tzone, int *day,int *month,int *year, double *h
 	double tsa;
 	double elev;
 
-/* Scalar values extracted from vectors passed to this 
-   function */
-	double daytemp;
-	double monthtemp;
-	double yeartemp;
-	double hhourtemp;
-	double xlattemp;
-	double xlontemp;
+	int daytemp = day;
+	int monthtemp = month;
+	int yeartemp = year;
+	double hhourtemp = hhour;
+	double xlattemp = xlat;
+	double xlontemp = xlon;
 
-	for (int i=0; i<*nrec; i++)
 	{
-		daytemp = day[i];
-		monthtemp = month[i];
-		yeartemp = year[i];
-		hhourtemp = hhour[i];
-		xlattemp = xlat[i];
-		xlontemp = xlon[i];
 
 		/* Corrrect Time for GMT */
 
-		hhourtemp = hhourtemp - (double) *tzone;
+		hhourtemp = hhourtemp - (double) tzone;
 
 		if (hhourtemp > 24.0)
 		{
@@ -252,15 +226,10 @@ void AstroCalc4R(int *nrec, int *tzone, int *day,int *month,int *year, double *h
 		}
 
 		/* Calculate Julian Day Starting at 4712 BCE
-		** Method from "Astronomical Algorithms" P. 61
+		** (integer Julian day number at noon, see calendar.h)
 		*/
 
-		xy = (double) yeartemp;
-		xm = (double) monthtemp;
-		xd = (double) daytemp + hhourtemp / 24.0; 
-
-
-		jd = JulianDay(xd,xm,xy);
+		jd = (double) julian_day_number(yeartemp, monthtemp, daytemp) - 0.5 + hhourtemp / 24.0;
 
 		/*  Calculate Julian Century
 		**  "Astronomical Algoritms" Eq. 25.1
@@ -273,14 +242,14 @@ void AstroCalc4R(int *nrec, int *tzone, int *day,int *month,int *year, double *h
 		*/
 
 		xx = 280.46646 + jc * (36000.76983 + 0.0003032 * jc);
-		gmls = fmod(xx,360.0);
+		gmls = M::fmod(xx,360.0);
 
 		/* Calculate Mean Anomaly of the Sun
 		** "Astronomical Algoritms" Eq. 25.3
 		*/
 
 		xx = 357.52911 + jc * (35999.05029 - 0.0001537 * jc);
-		gmas = fmod(xx,360.0);
+		gmas = M::fmod(xx,360.0);
 
 		/* Calculate Eccentricity of the Earth's orbit
 		** "Astronomical Algoritms" Eq. 25.4
@@ -292,9 +261,9 @@ void AstroCalc4R(int *nrec, int *tzone, int *day,int *month,int *year, double *h
 		*/
 
 		xx = gmas * XDEGRAD;
-		scx = (1.914602 - jc * (0.004817 + 1.4E-05 * jc)) * sin(xx);
-		scx += (0.019993 - 0.000101 * jc) * sin(2.0*xx);
-		scx += 0.000289 * sin(3.0*xx);
+		scx = (1.914602 - jc * (0.004817 + 1.4E-05 * jc)) * M::sin(xx);
+		scx += (0.019993 - 0.000101 * jc) * M::sin(2.0*xx);
+		scx += 0.000289 * M::sin(3.0*xx);
 
 		
 		/* Calculate Sun's True Longitude &
@@ -315,16 +284,16 @@ void AstroCalc4R(int *nrec, int *tzone, int *day,int *month,int *year, double *h
 
 		omega = 125.04 - 1934.136 * jc;
 		omega = omega * XDEGRAD;
-		lambda = stl - 0.00569 - 0.00478 * sin(omega);
+		lambda = stl - 0.00569 - 0.00478 * M::sin(omega);
 
 			/* Calculate Sun's Equation of the Center
 		** "Astronomical Algoritms" p. 164
 		*/
 
 		xx = gmas * XDEGRAD;
-		scx = (1.914602 - jc * (0.004817 + 1.4E-05 * jc)) * sin(xx);
-		scx += (0.019993 - 0.000101 * jc) * sin(2.0*xx);
-		scx += 0.000289 * sin(3.0*xx);
+		scx = (1.914602 - jc * (0.004817 + 1.4E-05 * jc)) * M::sin(xx);
+		scx += (0.019993 - 0.000101 * jc) * M::sin(2.0*xx);
+		scx += 0.000289 * M::sin(3.0*xx);
 
 		/* Calculate Sun's True Longitude &
 		** Sun's True Anomaly
@@ -344,7 +313,7 @@ void AstroCalc4R(int *nrec, int *tzone, int *day,int *month,int *year, double *h
 
 		omega = 125.04 - 1934.136 * jc;
 		omega = omega * XDEGRAD;
-		lambda = stl - 0.00569 - 0.00478 * sin(omega);
+		lambda = stl - 0.00569 - 0.00478 * M::sin(omega);
 
 		/* Calculate Mean Obliquity of the Ecliptic
 		** "Astronomical Algoritms" Eq. 22.2
@@ -357,7 +326,7 @@ void AstroCalc4R(int *nrec, int *tzone, int *day,int *month,int *year, double *h
 		** "Astronomical Algoritms" Eq. 25.8
 		*/
 
-		oblx = 0.00256 * cos(omega);
+		oblx = 0.00256 * M::cos(omega);
 
 		epsilon = epsilon + oblx;
 
@@ -373,10 +342,10 @@ void AstroCalc4R(int *nrec, int *tzone, int *day,int *month,int *year, double *h
 		** "Astronomical Algoritms" Eq. 25.7
 		*/
 
-		xx = sin(epsilon) * sin(lambda);
+		xx = M::sin(epsilon) * M::sin(lambda);
 
-		gamma = asin(xx);
-		declin[i] = gamma / XDEGRAD;
+		gamma = M::asin(xx);
+		out->declin = gamma / XDEGRAD;
 
 			/* Calculate Equation of Time
 		** "Astronomical Algoritms" Eq. 28.3
@@ -385,9 +354,9 @@ void AstroCalc4R(int *nrec, int *tzone, int *day,int *month,int *year, double *h
 		xx = gmls * XDEGRAD;
 		yy = gmas * XDEGRAD;
 
-		etime = EquationTime(epsilon,xx,eeo,yy);
+		etime = equation_time<M>(epsilon,xx,eeo,yy);
 
-		eqtime[i] = etime;
+		out->eqtime = etime;
 
 		/* Calculate Hour Angle
 		** "Astronomical Algoritms" Eq. 15.1
@@ -399,9 +368,9 @@ void AstroCalc4R(int *nrec, int *tzone, int *day,int *month,int *year, double *h
 
 		phi = xlattemp * XDEGRAD;
 
-		xx = (sin(hzero) - sin(phi) * sin(gamma)) / cos(phi) / cos(gamma);
+		xx = (M::sin(hzero) - M::sin(phi) * M::sin(gamma)) / M::cos(phi) / M::cos(gamma);
 		
-		hangle = acos(xx);
+		hangle = M::acos(xx);
 
 		hangle = hangle / XDEGRAD;
 
@@ -411,26 +380,26 @@ void AstroCalc4R(int *nrec, int *tzone, int *day,int *month,int *year, double *h
 		** 1440 Minutes in Day
 		*/
 
-		xx = (double) *tzone * 60.0;
+		xx = (double) tzone * 60.0;
 
-		noon[i] = (720. - 4.0 * xlontemp + xx - etime) / 1440.0;
+		out->noon = (720. - 4.0 * xlontemp + xx - etime) / 1440.0;
 
 
 		/* Calculate Sunrise & Sunset */
 		
 
-		sunrise[i] = ((noon[i] * 1440. - hangle * 4.0) / 1440.0) * 24. ;
-		sunset[i]  = ((noon[i] * 1440. + hangle * 4.0) / 1440.0) * 24. ;
-	    noon[i] = noon[i] * 24. ;
+		out->sunrise = ((out->noon * 1440. - hangle * 4.0) / 1440.0) * 24. ;
+		out->sunset  = ((out->noon * 1440. + hangle * 4.0) / 1440.0) * 24. ;
+	    out->noon = out->noon * 24. ;
 
 		/* Calculate Length of Day */
 
-		daytemp = hangle * 8.0;
+		double daylen = hangle * 8.0;
 
 		/* Calculate True Solar Time (minutes) */
 
 		xx = hhourtemp * 60.0 + etime + 4.0 * xlontemp;
-		tst = fmod(xx,1440.0);
+		tst = M::fmod(xx,1440.0);
 
 		/* Calculate the True Solar Angle (degrees) */
 
@@ -446,32 +415,93 @@ void AstroCalc4R(int *nrec, int *tzone, int *day,int *month,int *year, double *h
 
 		xx = tsa * XDEGRAD;
 
-		yy = sin(phi) * sin(gamma) + cos(phi) * cos(gamma) * cos(xx);
+		yy = M::sin(phi) * M::sin(gamma) + M::cos(phi) * M::cos(gamma) * M::cos(xx);
 
-		xx = asin(yy);
+		xx = M::asin(yy);
 
 		elev = xx / XDEGRAD;
 
-		zenith[i] = 90.0 - elev;
+		out->zenith = 90.0 - elev;
 
 		/* Calculate Azimuth (degress clockwise from N 
 		** "Astronomical Algoritms" P. 94
 		*/
 
-		yy = (sin(phi) * sin(xx) - sin(gamma)) / cos(phi) / cos(xx);
+		yy = (M::sin(phi) * M::sin(xx) - M::sin(gamma)) / M::cos(phi) / M::cos(xx);
 		
-		xx = acos(yy) / XDEGRAD;
+		xx = M::acos(yy) / XDEGRAD;
 
 		xx = xx + 180.0;
 
 		if (tsa > 0.0)
-			azimuth[i] = fmod(xx,360.0);
+			out->azimuth = M::fmod(xx,360.0);
 		else
-			azimuth[i] = 360.0 - fmod(xx,360.0);
+			out->azimuth = 360.0 - M::fmod(xx,360.0);
 
-		daylength[i] = daytemp / 60.0;	
+		out->daylength = daylen / 60.0;	
 		
-		par[i] = parcalc((double) zenith[i]);
+		out->par = par_calc<M>((double) out->zenith);
     }	
 	
-}
\ No newline at end of file
+}
+
+template <class M>
+static void astro_calc(int *nrec, int *tzone, int *day,int *month,int *year, double *hhour,double *xlat,double *xlon, \
+				 double *noon,double *sunrise,double *sunset,double *azimuth,double *zenith, \
+				 double *eqtime,double *declin, double *daylength, double *par)
+{
+	struct solar_output o;
+
+	for (int i=0; i<*nrec; i++)
+	{
+		astro_point<M>(*tzone, day[i], month[i], year[i], hhour[i], xlat[i], xlon[i], &o);
+		noon[i]      = o.noon;
+		sunrise[i]   = o.sunrise;
+		sunset[i]    = o.sunset;
+		azimuth[i]   = o.azimuth;
+		zenith[i]    = o.zenith;
+		eqtime[i]    = o.eqtime;
+		declin[i]    = o.declin;
+		daylength[i] = o.daylength;
+		par[i]       = o.par;
+	}
+}
+
+
+void AstroCalc4R(int *nrec, int *tzone, int *day,int *month,int *year, double *hhour,double *xlat,double *xlon, \
+				 double *noon,double *sunrise,double *sunset,double *azimuth,double *zenith, \
+				 double *eqtime,double *declin, double *daylength, double *par)
+{
+	astro_calc<libm_math>(nrec, tzone, day, month, year, hhour, xlat, xlon, noon, sunrise, sunset, 
+	                      azimuth, zenith, eqtime, declin, daylength, par);
+}
+
+/*
+**  Same as AstroCalc4R, using the polynomial approximations in fastmath.h 
+**  instead of libm. Sunrise/sunset agree with AstroCalc4R to within a few
+**  seconds (see fastmath_check), which is plenty for switching lights.
+*/
+void AstroCalc4RFast(int *nrec, int *tzone, int *day,int *month,int *year, double *hhour,double *xlat,double *xlon, \
+				 double *noon,double *sunrise,double *sunset,double *azimuth,double *zenith, \
+				 double *eqtime,double *declin, double *daylength, double *par)
+{
+	astro_calc<fast_math>(nrec, tzone, day, month, year, hhour, xlat, xlon, noon, sunrise, sunset, 
+	                      azimuth, zenith, eqtime, declin, daylength, par);
+}
+
+/*
+**  Batch interface of libsolar (see solar.h). One record per input, as 
+**  many as there is room for in the output; no allocations.
+*/
+template <class M>
+static size_t solar_batch(const struct solar_input *in, size_t n, int tzone, struct solar_output *out) noexcept
+{
+	for (size_t i = 0; i < n; i++)
+		astro_point<M>(tzone, in[i].day, in[i].month, in[i].year, in[i].hour, in[i].lat, in[i].lon, &out[i]);
+	return n;
+}
+
+size_t solar_calc(const struct solar_input *in, size_t n, int tzone, int fast, struct solar_output *out)
+{
+	return fast ? solar_batch<fast_math>(in, n, tzone, out) : solar_batch<libm_math>(in, n, tzone, out);
+}
@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include "fastmath.h"
 
 int isleap(int);
 int daymonth(int, int);
@@ -14,3 +15,6 @@ double parcalc(double);
 void AstroCalc4R(int *, int *, int *,int *,int *, double *,double *,double *, \
 				 double *,double *,double *,double *,double *, \
 				 double *,double *, double *, double *);
+void AstroCalc4RFast(int *, int *, int *,int *,int *, double *,double *,double *, \
+				 double *,double *,double *,double *,double *, \
+				 double *,double *, double *, double *);
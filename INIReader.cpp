@@ -25,8 +25,10 @@ int INIReader::ParseError()
 
 string INIReader::Get(string section, string name, string default_value)
 {
-    string key = MakeKey(section, name);
-    return _values.count(key) ? _values[key] : default_value;
+    char buffer[INI_KEY];
+    std::pmr::monotonic_buffer_resource key_pool(buffer, sizeof(buffer));
+    auto it = _values.find(std::string_view(MakeKey(section, name, &key_pool)));
+    return it != _values.end() ? string(it->second) : default_value;
 }
 
 long INIReader::GetInteger(string section, string name, long default_value)
@@ -61,9 +63,31 @@ bool INIReader::GetBoolean(string section, string name, bool default_value)
         return default_value;
 }
 
-string INIReader::MakeKey(string section, string name)
+const std::pmr::set<std::pmr::string, std::less<> >& INIReader::Sections() const
 {
-    string key = section + "=" + name;
+    return _sections;
+}
+
+std::vector<string> INIReader::Keys(string section) const
+{
+    char buffer[INI_KEY];
+    std::pmr::monotonic_buffer_resource key_pool(buffer, sizeof(buffer));
+    std::pmr::string prefix = MakeKey(section, "", &key_pool);
+    std::vector<string> keys;
+    for (auto it = _values.lower_bound(std::string_view(prefix));
+         it != _values.end() && it->first.compare(0, prefix.size(), prefix) == 0; ++it)
+        keys.push_back(string(it->first.substr(prefix.size())));
+    return keys;
+}
+
+// The key of a value, allocated from 'resource': the reader's arena for
+// the values read, a buffer on the stack for a lookup
+std::pmr::string INIReader::MakeKey(std::string_view section, std::string_view name,
+                                    std::pmr::memory_resource *resource)
+{
+    std::pmr::string key(resource);
+    key.reserve(section.size() + 1 + name.size());
+    key.append(section).append("=").append(name);
     // Convert to lower case to make section/name lookups case-insensitive
     std::transform(key.begin(), key.end(), key.begin(), ::tolower);
     return key;
@@ -73,10 +97,12 @@ int INIReader::ValueHandler(void* user, const char* section, const char* name,
                             const char* value)
 {
     INIReader* reader = (INIReader*)user;
-    string key = MakeKey(section, name);
-    if (reader->_values[key].size() > 0)
-        reader->_values[key] += "\n";
-    reader->_values[key] += value;
+    std::pmr::string &v = reader->_values[MakeKey(section, name, &reader->_pool)];
+    if (v.size() > 0)
+        v += "\n";
+    v += value;
+    if (reader->_sections.find(std::string_view(section)) == reader->_sections.end())
+        reader->_sections.emplace(section);
     return 1;
 }
 
@@ -9,7 +9,14 @@
 #define __INIREADER_H__
 
 #include <map>
+#include <set>
 #include <string>
+#include <string_view>
+#include <vector>
+#include <memory_resource>
+
+#define INI_ARENA 8192	// bytes for the names and values before falling back to the heap
+#define INI_KEY   128	// bytes on the stack for the key of a lookup
 
 // Read an INI file into easy-to-access name/value pairs. (Note that I've gone
 // for simplicity here rather than speed, but it should be pretty decent.)
@@ -42,10 +49,21 @@ public:
     // and valid false values are "false", "no", "off", "0" (not case sensitive).
     bool GetBoolean(std::string section, std::string name, bool default_value);
 
+    // Return the set of sections found in the INI file.
+    const std::pmr::set<std::pmr::string, std::less<> >& Sections() const;
+
+    // Return the names (in lower case) of the values in a section.
+    std::vector<std::string> Keys(std::string section) const;
+
 private:
     int _error;
-    std::map<std::string, std::string> _values;
-    static std::string MakeKey(std::string section, std::string name);
+    // everything read from the file lives in a fixed arena inside the object
+    alignas(std::max_align_t) char _arena[INI_ARENA];
+    std::pmr::monotonic_buffer_resource _pool{_arena, sizeof(_arena)};
+    std::pmr::map<std::pmr::string, std::pmr::string, std::less<> > _values{&_pool};
+    std::pmr::set<std::pmr::string, std::less<> > _sections{&_pool};
+    static std::pmr::string MakeKey(std::string_view section, std::string_view name,
+                                    std::pmr::memory_resource *resource);
     static int ValueHandler(void* user, const char* section, const char* name,
                             const char* value);
 };
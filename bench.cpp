@@ -0,0 +1,113 @@
+/*
+bench.cpp
+
+Benchmark runner.
+
+A case is run once to warm up caches and page in its data, then once
+more to estimate how many calls fit in the time per case, then that
+many times while the clock and the counters run. Results are per
+operation, so cases with different batch sizes compare directly.
+Counters that are not available print as '-'; if none is, the table has
+the times only and a note says why.
+*/
+
+#include "bench.h"
+#include "perfcount.h"
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+
+static double now_s(void)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// value per operation, or '-'
+static void column(const struct perf_counters *pc, int k, double ops, const char *format, int width)
+{
+  if (perf_has(pc, k))
+    printf(format, width, pc->value[k] / ops);
+  else
+    printf(" %*s", width, "-");
+}
+
+// a share in percent, or '-'
+static void ratio(const struct perf_counters *pc, int part, int whole, int width)
+{
+  if (perf_has(pc, part) && perf_has(pc, whole) && pc->value[whole] > 0)
+    printf(" %*.2f%%", width - 1, 100.0 * pc->value[part] / pc->value[whole]);
+  else
+    printf(" %*s", width, "-");
+}
+
+// **********************************************************************
+//      Run every case for about 'seconds', with the event counters if
+//      'counters'. Returns 0.
+// **********************************************************************
+int bench_run(const std::vector<struct bench_case> &cases, bool counters, double seconds)
+{
+  struct perf_counters pc;
+  int available = 0;
+  for (int k = 0; k < PC_COUNTERS; k++)
+    pc.fd[k] = -1;
+  if (counters) {
+    available = perf_open(&pc);
+    if (available == 0) {
+      int paranoid = -1;
+      FILE *fp = fopen("/proc/sys/kernel/perf_event_paranoid", "r");
+      if (fp != NULL) {
+        if (fscanf(fp, "%d", &paranoid) != 1)
+          paranoid = -1;
+        fclose(fp);
+      }
+      printf("No event counters (kernel.perf_event_paranoid = %d, no PMU in a VM or container?): times only\n\n",
+             paranoid);
+    }
+  }
+
+  printf("%-16s %8s %10s", "case", "ops/run", "ns/op");
+  if (available > 0)
+    printf(" %10s %10s %6s %8s %8s %10s", "cycles/op", "instr/op", "IPC", "br-miss", "$-miss", "faults/run");
+  printf("\n");
+
+  for (const struct bench_case &c : cases) {
+    c.run();
+    double t0 = now_s();
+    c.run();
+    double once = std::max(now_s() - t0, 1e-9);
+    long runs = std::max(1L, (long) (seconds / once));
+
+    if (available > 0)
+      perf_start(&pc);
+    t0 = now_s();
+    for (long r = 0; r < runs; r++)
+      c.run();
+    double elapsed = now_s() - t0;
+    if (available > 0)
+      perf_stop(&pc);
+
+    double ops = (double) runs * c.ops;
+    printf("%-16s %8ld %10.1f", c.name, c.ops, 1e9 * elapsed / ops);
+    if (available > 0) {
+      column(&pc, PC_CYCLES, ops, " %*.1f", 10);
+      column(&pc, PC_INSTRUCTIONS, ops, " %*.1f", 10);
+      if (perf_has(&pc, PC_CYCLES) && perf_has(&pc, PC_INSTRUCTIONS) && pc.value[PC_CYCLES] > 0)
+        printf(" %6.2f", (double) pc.value[PC_INSTRUCTIONS] / pc.value[PC_CYCLES]);
+      else
+        printf(" %6s", "-");
+      ratio(&pc, PC_BRANCH_MISSES, PC_BRANCHES, 8);
+      ratio(&pc, PC_CACHE_MISSES, PC_CACHE_REFS, 8);
+      column(&pc, PC_PAGE_FAULTS, (double) runs, " %*.2f", 10);
+    }
+    printf("\n");
+  }
+
+  if (available > 0) {
+    printf("\ncounters:");
+    for (int k = 0; k < PC_COUNTERS; k++)
+      printf(" %s%s", perf_name(k), perf_has(&pc, k) ? "" : " (n/a)");
+    printf("\n");
+  }
+  perf_close(&pc);
+  return 0;
+}
@@ -0,0 +1,35 @@
+/*
+	bench.h
+
+	Benchmark runner for the hot paths (solar kernel, configuration
+	parser, planner). Each case is run for about a given time; with
+	counters it is also measured with perfcount.h, to see why one build
+	or CPU is faster than another: instructions and cycles per operation,
+	IPC, branch and cache miss rates, page faults.
+*/
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <functional>
+#include <vector>
+
+#define BENCH_SECONDS 0.5	// time per case
+
+struct bench_case {
+  const char *name;
+  long ops;                       // operations done by one call of run()
+  std::function<void()> run;
+};
+
+int bench_run(const std::vector<struct bench_case> &, bool, double);
+
+// Makes the compiler assume that 'value' (and what it points into) is
+// read, so the work that produced it is not optimized away. An empty
+// asm statement: costs no instruction.
+template <typename T>
+inline void bench_keep(const T &value)
+{
+  asm volatile("" : : "r"(&value) : "memory");
+}
+
+#endif
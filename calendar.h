@@ -0,0 +1,132 @@
+/*
+	calendar.h
+
+	Integer calendar arithmetic on the proleptic Gregorian calendar:
+	days since 1970-01-01 from a date and back, Julian day numbers and
+	days of the year. Everything is constexpr and free of libc calls,
+	time zone lookups and locks, so it is cheap enough for loops over
+	decades of dates. The conversions follow H. Hinnant, "chrono-
+	Compatible Low-Level Date Algorithms" and agree with
+	std::chrono::sys_days; with C++20 there are overloads on the
+	std::chrono calendar types.
+*/
+#ifndef CALENDAR_H
+#define CALENDAR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CAL_UNIX_EPOCH_JDN 2440588	// Julian day number of 1970-01-01
+
+struct civil_date {
+  int32_t year, month, day;
+};
+
+// **********************************************************************
+//      Division rounding towards minus infinity
+// **********************************************************************
+constexpr int64_t cal_floor_div(int64_t a, int64_t b)
+{
+  return a / b - (a % b != 0 && (a < 0) != (b < 0));
+}
+
+constexpr bool cal_is_leap(int32_t y)
+{
+  return (y % 4 == 0 && y % 100 != 0) || y % 400 == 0;
+}
+
+constexpr int cal_days_in_month(int32_t y, int m)
+{
+  return m == 2 ? (cal_is_leap(y) ? 29 : 28) : 30 + ((m + (m > 7)) & 1);
+}
+
+// **********************************************************************
+//      Days since 1970-01-01 of a date
+// **********************************************************************
+constexpr int32_t days_from_civil(int32_t y, int m, int d)
+{
+  y -= m <= 2;
+  const int32_t era = (y >= 0 ? y : y - 399) / 400;
+  const int32_t yoe = y - era * 400;                                  // [0, 399]
+  const int32_t doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1; // [0, 365]
+  const int32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;          // [0, 146096]
+  return era * 146097 + doe - 719468;
+}
+
+// **********************************************************************
+//      Date of a number of days since 1970-01-01
+// **********************************************************************
+constexpr struct civil_date civil_from_days(int32_t z)
+{
+  z += 719468;
+  const int32_t era = (z >= 0 ? z : z - 146096) / 146097;
+  const int32_t doe = z - era * 146097;
+  const int32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  const int32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  const int32_t mp  = (5 * doy + 2) / 153;
+  const int32_t d   = doy - (153 * mp + 2) / 5 + 1;
+  const int32_t m   = mp < 10 ? mp + 3 : mp - 9;
+  return { yoe + era * 400 + (m <= 2), m, d };
+}
+
+// Julian day number: the Julian date at noon of the given day
+constexpr int32_t julian_day_number(int32_t y, int m, int d)
+{
+  return days_from_civil(y, m, d) + CAL_UNIX_EPOCH_JDN;
+}
+
+// Day of the year, 1 for January 1st
+constexpr int day_of_year(int32_t y, int m, int d)
+{
+  return days_from_civil(y, m, d) - days_from_civil(y, 1, 1) + 1;
+}
+
+// Days since 1970-01-01 of a time, at a fixed offset (in hours) from UTC
+constexpr int32_t day_of_time(int64_t t, int tzone)
+{
+  return (int32_t) cal_floor_div(t + 3600 * (int64_t) tzone, 86400);
+}
+
+static_assert(days_from_civil(1970, 1, 1) == 0);
+static_assert(days_from_civil(2000, 3, 1) == 11017);
+static_assert(civil_from_days(-1).year == 1969 && civil_from_days(-1).day == 31);
+static_assert(julian_day_number(2000, 1, 1) == 2451545);
+static_assert(day_of_year(2024, 12, 31) == 366);
+static_assert(cal_days_in_month(2023, 2) == 28 && cal_days_in_month(2023, 7) == 31 &&
+              cal_days_in_month(2023, 8) == 31 && cal_days_in_month(2023, 11) == 30);
+
+// **********************************************************************
+//      Batch conversions
+// **********************************************************************
+inline void civil_from_days(const int32_t *days, size_t n, struct civil_date *out)
+{
+  for (size_t i = 0; i < n; i++)
+    out[i] = civil_from_days(days[i]);
+}
+
+inline void days_from_civil(const struct civil_date *dates, size_t n, int32_t *out)
+{
+  for (size_t i = 0; i < n; i++)
+    out[i] = days_from_civil(dates[i].year, dates[i].month, dates[i].day);
+}
+
+#if __cplusplus >= 202002L
+#include <chrono>
+
+constexpr int32_t days_from_civil(std::chrono::year_month_day ymd)
+{
+  return days_from_civil((int) ymd.year(), (int) (unsigned) ymd.month(), (int) (unsigned) ymd.day());
+}
+
+constexpr std::chrono::year_month_day civil_from_days(std::chrono::sys_days t)
+{
+  const struct civil_date c = civil_from_days((int32_t) t.time_since_epoch().count());
+  return std::chrono::year_month_day(std::chrono::year(c.year), std::chrono::month(c.month),
+                                     std::chrono::day(c.day));
+}
+
+static_assert(days_from_civil(std::chrono::year(2026) / 10 / 19) ==
+              std::chrono::sys_days(std::chrono::year(2026) / 10 / 19).time_since_epoch().count());
+#endif
+
+#endif
@@ -0,0 +1,425 @@
+/*
+daycal.cpp
+
+Day rules compiled to bitsets.
+
+Bit k of a rule is day first + k, and first is a January 1st, so the
+bitsets of all rules line up and a rule that refers to others is their
+OR (or AND NOT, for exclusions) word by word. Weekday terms repeat every
+7 words: 7 * 64 days are a whole number of weeks. Date terms set runs of
+bits, whole words at a time. A rule that holds on February 29th only
+holds in leap years; a yearly range that starts on it starts on March
+1st in the other years.
+*/
+
+#include "daycal.h"
+#include "calendar.h"
+#include <ctype.h>
+#include <string.h>
+#include <strings.h>
+#include <algorithm>
+#include <bit>
+#include <chrono>
+
+static const char *weekday_names[7] = { "mon", "tue", "wed", "thu", "fri", "sat", "sun" };
+
+// **********************************************************************
+//      Parsing
+// **********************************************************************
+static int parse_weekday(const std::string &s)
+{
+  for (int i = 0; i < 7; i++) {
+    if (strcasecmp(s.c_str(), weekday_names[i]) == 0)
+      return i;
+  }
+  return -1;
+}
+
+// MM-DD as month * 100 + day, or -1
+static int parse_month_day(const std::string &s)
+{
+  int m, d, n = 0;
+  if (sscanf(s.c_str(), "%2d-%2d%n", &m, &d, &n) != 2 || n != (int) s.size() || m < 1 || m > 12 || d < 1 ||
+      d > cal_days_in_month(2000, m))
+    return -1;
+  return 100 * m + d;
+}
+
+// YYYY-MM-DD as days since the epoch, or INT32_MIN
+static int32_t parse_date(const std::string &s)
+{
+  int y, m, d, n = 0;
+  if (sscanf(s.c_str(), "%4d-%2d-%2d%n", &y, &m, &d, &n) != 3 || n != (int) s.size() || m < 1 || m > 12 ||
+      d < 1 || d > cal_days_in_month(y, m))
+    return INT32_MIN;
+  return days_from_civil(y, m, d);
+}
+
+// weekdays of a built-in day name, 0 if it is none
+static int builtin_days(const std::string &name)
+{
+  if (strcasecmp(name.c_str(), "weekdays") == 0)
+    return 0x1f;
+  if (strcasecmp(name.c_str(), "weekend") == 0 || strcasecmp(name.c_str(), "weekends") == 0)
+    return 0x60;
+  return 0;
+}
+
+static int parse_term(struct day_term *t, std::string text)
+{
+  t->exclude = !text.empty() && text[0] == '!';
+  if (t->exclude)
+    text.erase(0, 1);
+  size_t dots = text.find("..");
+  std::string lo = text.substr(0, dots);
+  std::string hi = dots == std::string::npos ? lo : text.substr(dots + 2);
+  size_t dash = text.find('-');
+
+  if (strcasecmp(text.c_str(), "all") == 0) {
+    t->kind = CAL_ALL;
+  } else if (parse_weekday(text) >= 0 ||
+             (dash != std::string::npos && parse_weekday(text.substr(0, dash)) >= 0)) {
+    // mon, or mon-fri (fri-mon wraps around the weekend)
+    int a = parse_weekday(text.substr(0, dash));
+    int b = dash == std::string::npos ? a : parse_weekday(text.substr(dash + 1));
+    if (b < 0)
+      return 1;
+    t->kind = CAL_WEEKDAYS;
+    t->a = 0;
+    for (int i = a; ; i = (i + 1) % 7) {
+      t->a |= 1 << i;
+      if (i == b)
+        break;
+    }
+  } else if (parse_month_day(lo) >= 0) {
+    t->kind = CAL_YEARLY;
+    t->a = parse_month_day(lo);
+    t->b = parse_month_day(hi);
+    if (t->b < 0)
+      return 1;
+  } else if (parse_date(lo) != INT32_MIN) {
+    t->kind = CAL_DATES;
+    t->a = parse_date(lo);
+    t->b = parse_date(hi);
+    if (t->b == INT32_MIN || t->b < t->a)
+      return 1;
+  } else {
+    // the name of another rule, resolved when the calendar is compiled
+    for (char c : text) {
+      if (!isalnum((unsigned char) c) && c != '_')
+        return 1;
+    }
+    t->kind = CAL_RULE;
+    t->a = -1;
+    t->b = builtin_days(text);
+    t->name = text;
+  }
+  return 0;
+}
+
+// **********************************************************************
+//      Add rule 'name' with the terms in 'text' (separated by commas or
+//      blanks). Returns its index, or -1 if the text is not a rule.
+// **********************************************************************
+int daycal_add(struct day_calendar *cal, const std::string &name, const std::string &text)
+{
+  struct day_rule rule;
+  rule.name = name;
+  size_t start = 0;
+  while (start < text.size()) {
+    size_t end = text.find_first_of(", \t", start);
+    if (end == std::string::npos)
+      end = text.size();
+    if (end > start) {
+      struct day_term t;
+      if (parse_term(&t, text.substr(start, end - start)) != 0) {
+        fprintf(stderr, "Invalid day '%s' in rule %s\n", text.substr(start, end - start).c_str(), name.c_str());
+        return -1;
+      }
+      rule.terms.push_back(t);
+    }
+    start = end + 1;
+  }
+  if (rule.terms.empty()) {
+    fprintf(stderr, "Empty day rule %s\n", name.c_str());
+    return -1;
+  }
+
+  // the bitsets have to be compiled again
+  cal->rules.push_back(rule);
+  cal->first = 1;
+  cal->last  = 0;
+  cal->words = 0;
+  cal->bits.clear();
+  return (int) cal->rules.size() - 1;
+}
+
+int daycal_find(const struct day_calendar *cal, const std::string &name)
+{
+  for (size_t r = 0; r < cal->rules.size(); r++) {
+    if (strcasecmp(cal->rules[r].name.c_str(), name.c_str()) == 0)
+      return (int) r;
+  }
+  return -1;
+}
+
+// **********************************************************************
+//      A rule by name, or else an unnamed rule with the terms in 'text'
+//      (for 'days = sat, sun'). -1 if it is neither.
+// **********************************************************************
+int daycal_rule(struct day_calendar *cal, const std::string &text)
+{
+  int r = daycal_find(cal, text);
+  return r >= 0 ? r : daycal_add(cal, text, text);
+}
+
+// **********************************************************************
+//      Compilation
+// **********************************************************************
+
+// set bits [lo, hi], clipped to the n bits of w
+static void set_range(uint64_t *w, int64_t lo, int64_t hi, int64_t n)
+{
+  lo = std::max<int64_t>(lo, 0);
+  hi = std::min<int64_t>(hi, n - 1);
+  if (lo > hi)
+    return;
+  size_t a = (size_t) lo >> 6, b = (size_t) hi >> 6;
+  uint64_t first = ~0ull << (lo & 63);
+  uint64_t last  = ~0ull >> (63 - (hi & 63));
+  if (a == b) {
+    w[a] |= first & last;
+    return;
+  }
+  w[a] |= first;
+  for (size_t k = a + 1; k < b; k++)
+    w[k] = ~0ull;
+  w[b] |= last;
+}
+
+// first day of the yearly date md in year y (February 29th: March 1st)
+static int32_t yearly_start(int32_t y, int md)
+{
+  return days_from_civil(y, md / 100, 1) + md % 100 - 1;
+}
+
+// last day of the yearly date md in year y (February 29th: February 28th)
+static int32_t yearly_end(int32_t y, int md)
+{
+  return days_from_civil(y, md / 100, 1) + std::min(md % 100, cal_days_in_month(y, md / 100)) - 1;
+}
+
+static void compile_term(const struct day_calendar *cal, const struct day_term *t, uint64_t *w, int64_t n)
+{
+  switch (t->kind) {
+  case CAL_ALL:
+    set_range(w, 0, n - 1, n);
+    break;
+  case CAL_WEEKDAYS: {
+    uint64_t week [7] = { 0 };
+    for (int k = 0; k < 7 * 64; k++) {
+      if (t->a & (1 << cal_weekday((int32_t) (cal->first + k))))
+        week[k >> 6] |= 1ull << (k & 63);
+    }
+    for (size_t k = 0; k < cal->words; k++)
+      w[k] |= week[k % 7];
+    break;
+  }
+  case CAL_YEARLY: {
+    int32_t y0 = civil_from_days(cal->first).year, y1 = civil_from_days(cal->last).year;
+    for (int32_t y = y0 - 1; y <= y1; y++) {
+      int32_t lo = yearly_start(y, t->a);
+      int32_t hi = yearly_end(t->b >= t->a ? y : y + 1, t->b);
+      set_range(w, lo - cal->first, hi - cal->first, n);
+    }
+    break;
+  }
+  case CAL_DATES:
+    set_range(w, (int64_t) t->a - cal->first, (int64_t) t->b - cal->first, n);
+    break;
+  case CAL_RULE:
+    for (size_t k = 0; k < cal->words; k++)
+      w[k] |= cal->bits[t->a * cal->words + k];
+    break;
+  }
+}
+
+// compile rule r after the rules it refers to; state 1 = in progress
+static int compile_rule(struct day_calendar *cal, int r, std::vector<char> &state)
+{
+  if (state[r] == 2)
+    return 0;
+  if (state[r] == 1) {
+    fprintf(stderr, "Day rule %s refers to itself\n", cal->rules[r].name.c_str());
+    return 1;
+  }
+  state[r] = 1;
+  for (const struct day_term &t : cal->rules[r].terms) {
+    if (t.kind == CAL_RULE && compile_rule(cal, t.a, state) != 0)
+      return 1;
+  }
+
+  int64_t n = (int64_t) cal->last - cal->first + 1;
+  std::vector<uint64_t> in (cal->words, 0), out (cal->words, 0);
+  bool any = false;
+  for (const struct day_term &t : cal->rules[r].terms) {
+    compile_term(cal, &t, t.exclude ? out.data() : in.data(), n);
+    any |= !t.exclude;
+  }
+  uint64_t *w = &cal->bits[r * cal->words];
+  for (size_t k = 0; k < cal->words; k++)
+    w[k] = (any ? in[k] : ~0ull) & ~out[k];
+  if (n & 63)
+    w[cal->words - 1] &= ~0ull >> (64 - (n & 63));
+  state[r] = 2;
+  return 0;
+}
+
+// **********************************************************************
+//      Compile every rule for the whole years from day 'first' to day
+//      'last'. Returns 0, or 1 if a rule refers to an unknown rule or to
+//      itself.
+// **********************************************************************
+int daycal_compile(struct day_calendar *cal, int32_t first, int32_t last)
+{
+  // names: a rule of the calendar, or else a built-in name (also in
+  // a rule of that name: 'weekend = weekend, fri')
+  for (size_t r = 0; r < cal->rules.size(); r++) {
+    for (struct day_term &t : cal->rules[r].terms) {
+      if (t.name.empty())
+        continue;
+      int found = daycal_find(cal, t.name);
+      if (t.b != 0 && (found < 0 || found == (int) r)) {
+        t.kind = CAL_WEEKDAYS;
+        t.a = t.b;
+        continue;
+      }
+      t.kind = CAL_RULE;
+      t.a = found;
+      if (t.a < 0) {
+        fprintf(stderr, "Unknown day rule %s in rule %s\n", t.name.c_str(), cal->rules[r].name.c_str());
+        return 1;
+      }
+    }
+  }
+
+  cal->first = days_from_civil(civil_from_days(first).year, 1, 1);
+  cal->last  = days_from_civil(civil_from_days(last).year, 12, 31);
+  cal->words = ((size_t) (cal->last - cal->first) + 64) / 64;
+  cal->bits.assign(cal->rules.size() * cal->words, 0);
+
+  std::vector<char> state(cal->rules.size(), 0);
+  for (size_t r = 0; r < cal->rules.size(); r++) {
+    if (compile_rule(cal, (int) r, state) != 0) {
+      cal->first = 1;
+      cal->last  = 0;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// **********************************************************************
+//      Rule r on day d from its terms (for days outside the bitsets)
+// **********************************************************************
+static bool term_holds(const struct day_calendar *cal, const struct day_term *t, int32_t d)
+{
+  switch (t->kind) {
+  case CAL_ALL:
+    return true;
+  case CAL_WEEKDAYS:
+    return t->a & (1 << cal_weekday(d));
+  case CAL_YEARLY: {
+    struct civil_date c = civil_from_days(d);
+    int md = 100 * c.month + c.day;
+    return t->a <= t->b ? md >= t->a && md <= t->b : md >= t->a || md <= t->b;
+  }
+  case CAL_DATES:
+    return d >= t->a && d <= t->b;
+  case CAL_RULE:
+    return t->a >= 0 && daycal_eval(cal, t->a, d);
+  }
+  return false;
+}
+
+bool daycal_eval(const struct day_calendar *cal, int r, int32_t d)
+{
+  bool any = false, in = false;
+  for (const struct day_term &t : cal->rules[r].terms) {
+    if (t.exclude) {
+      if (term_holds(cal, &t, d))
+        return false;
+    } else {
+      any = true;
+      in  = in || term_holds(cal, &t, d);
+    }
+  }
+  return !any || in;
+}
+
+// **********************************************************************
+//      Number of days in [from, to] on which rule r holds
+// **********************************************************************
+int daycal_count(const struct day_calendar *cal, int r, int32_t from, int32_t to)
+{
+  int count = 0;
+  for (; from <= to && (from < cal->first || from > cal->last || ((from - cal->first) & 63)); from++)
+    count += daycal_test(cal, r, from);
+  // whole words of the bitset
+  for (; from + 63 <= to && from + 63 <= cal->last; from += 64)
+    count += std::popcount(cal->bits[r * cal->words + ((from - cal->first) >> 6)]);
+  for (; from <= to; from++)
+    count += daycal_test(cal, r, from);
+  return count;
+}
+
+// **********************************************************************
+//      Print the days of every rule in the year of day 'day', and what a
+//      test costs. Returns 0.
+// **********************************************************************
+int daycal_report(FILE *fp, const struct day_calendar *cal, int32_t day)
+{
+  int32_t y = civil_from_days(day).year;
+  int32_t first = days_from_civil(y, 1, 1), last = days_from_civil(y, 12, 31);
+
+  for (size_t r = 0; r < cal->rules.size(); r++) {
+    fprintf(fp, "%-16s %3d days:", cal->rules[r].name.c_str(), daycal_count(cal, (int) r, first, last));
+    // runs of days
+    int runs = 0;
+    for (int32_t d = first; d <= last; d++) {
+      if (!daycal_test(cal, (int) r, d))
+        continue;
+      int32_t e = d;
+      while (e < last && daycal_test(cal, (int) r, e + 1))
+        e++;
+      if (++runs > 8) {
+        fprintf(fp, " ...");
+        break;
+      }
+      struct civil_date a = civil_from_days(d), b = civil_from_days(e);
+      if (e == d)
+        fprintf(fp, " %02d-%02d", a.month, a.day);
+      else
+        fprintf(fp, " %02d-%02d..%02d-%02d", a.month, a.day, b.month, b.day);
+      d = e;
+    }
+    fprintf(fp, "\n");
+  }
+  if (cal->rules.empty() || cal->first > cal->last)
+    return 0;
+
+  // every rule on every compiled day
+  const int rounds = 100;
+  long hits = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  for (int i = 0; i < rounds; i++)
+    for (size_t r = 0; r < cal->rules.size(); r++)
+      for (int32_t d = cal->first; d <= cal->last; d++)
+        hits += daycal_test(cal, (int) r, d);
+  auto t1 = std::chrono::steady_clock::now();
+  double tests = (double) rounds * cal->rules.size() * (cal->last - cal->first + 1);
+  fprintf(fp, "\n%zu rule(s) compiled for %d-%d, %zu bytes, %.2f ns per test (%ld)\n", cal->rules.size(),
+          civil_from_days(cal->first).year, civil_from_days(cal->last).year, cal->bits.size() * 8,
+          std::chrono::duration<double, std::nano>(t1 - t0).count() / tests, hits);
+  return 0;
+}
@@ -0,0 +1,82 @@
+/*
+	daycal.h
+
+	Day rules: on which days a switch is planned, or vacation mode is on.
+	A rule is a list of terms: weekdays (mon-fri), dates recurring every
+	year (12-25, 12-24..01-01), dates and ranges of dates (2026-11-26,
+	2026-08-01..2026-08-21) and other rules by name. 'weekdays' and
+	'weekend' are names too: they mean mon-fri and sat-sun unless the
+	calendar defines a rule of that name.
+	It holds on the days of any of its terms, or on every day if it only has exclusions
+	(!holidays), and never on the days of an exclusion. At load time every rule is compiled
+	to a bitset with one bit per day of the years around today, combining
+	the terms a word (64 days) at a time; whether rule R holds on day D is
+	then a single bit test, whatever the number or kind of rules. Days
+	outside the compiled years are evaluated from the terms.
+*/
+#ifndef DAYCAL_H
+#define DAYCAL_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#define CAL_YEARS_BEFORE 1	// years compiled before the current one
+#define CAL_YEARS_AFTER  3	// ... and after it
+
+#define CAL_ALL      0	// every day
+#define CAL_WEEKDAYS 1	// a = mask of weekdays (bit 0 = Monday)
+#define CAL_YEARLY   2	// a, b = first and last month * 100 + day
+#define CAL_DATES    3	// a, b = first and last day (since the epoch)
+#define CAL_RULE     4	// a = index of another rule (b = weekday mask of a
+			// built-in name, used if no rule has the name)
+
+struct day_term {
+  int     kind;
+  bool    exclude;        // '!': the rule does not hold on these days
+  int32_t a, b;
+  std::string name;       // of the rule of a CAL_RULE term (kept when a
+                          // built-in name is resolved to CAL_WEEKDAYS)
+};
+
+struct day_rule {
+  std::string name;
+  std::vector<struct day_term> terms;
+};
+
+struct day_calendar {
+  std::vector<struct day_rule> rules;
+  int32_t first, last;            // days covered by the bitsets
+  size_t  words;                  // 64-bit words per rule
+  std::vector<uint64_t> bits;     // rule r has words [r * words, (r + 1) * words)
+};
+
+// Day of the week, 0 = Monday (1970-01-01 was a Thursday)
+constexpr int cal_weekday(int32_t day)
+{
+  return (int) ((day % 7 + 7 + 3) % 7);
+}
+
+int  daycal_add(struct day_calendar *, const std::string &, const std::string &);
+int  daycal_find(const struct day_calendar *, const std::string &);
+int  daycal_rule(struct day_calendar *, const std::string &);
+int  daycal_compile(struct day_calendar *, int32_t, int32_t);
+bool daycal_eval(const struct day_calendar *, int, int32_t);
+int  daycal_count(const struct day_calendar *, int, int32_t, int32_t);
+int  daycal_report(FILE *, const struct day_calendar *, int32_t);
+
+// **********************************************************************
+//      Does rule r hold on day d (r < 0: no rule, every day)
+// **********************************************************************
+inline bool daycal_test(const struct day_calendar *cal, int r, int32_t d)
+{
+  if (r < 0)
+    return true;
+  if (d < cal->first || d > cal->last)
+    return daycal_eval(cal, r, d);
+  uint32_t k = (uint32_t) (d - cal->first);
+  return (cal->bits[r * cal->words + (k >> 6)] >> (k & 63)) & 1;
+}
+
+#endif
@@ -0,0 +1,87 @@
+/*
+dutycycle.cpp
+
+Sliding-window airtime budget.
+
+Every burst is logged with its end time and on-air time; bursts older
+than the window drop out of the log and give their airtime back. The
+budget left is therefore exact for the window that ends now, not an
+approximation by a refill rate, and the time until a burst of a given
+airtime fits follows from the log: the oldest bursts have to expire
+until enough airtime is free. Transmitters send a few bursts a day, so
+the log stays short.
+*/
+
+#include "dutycycle.h"
+#include <time.h>
+
+// **********************************************************************
+//      Limit 'percent' of every 'window' seconds (percent <= 0: no limit)
+// **********************************************************************
+void duty_init(struct duty_budget *b, double percent, int window)
+{
+  b->window = (int64_t) window * 1000000;
+  b->limit  = percent > 0 ? (int64_t) (b->window * percent / 100) : 0;
+  b->used   = 0;
+  b->log.clear();
+}
+
+int64_t duty_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void expire(struct duty_budget *b, int64_t now)
+{
+  while (!b->log.empty() && b->log.front().end <= now - b->window) {
+    b->used -= b->log.front().air;
+    b->log.pop_front();
+  }
+}
+
+// **********************************************************************
+//      On-air time (us) that may be used now (INT64_MAX without a limit)
+// **********************************************************************
+int64_t duty_available(struct duty_budget *b, int64_t now)
+{
+  if (b->limit == 0)
+    return INT64_MAX;
+  expire(b, now);
+  return b->used < b->limit ? b->limit - b->used : 0;
+}
+
+// **********************************************************************
+//      Time (us) until 'air' us of on-air time are available: 0 if now,
+//      -1 if never (more than the whole budget)
+// **********************************************************************
+int64_t duty_wait(struct duty_budget *b, int64_t now, int64_t air)
+{
+  if (b->limit == 0)
+    return 0;
+  if (air > b->limit)
+    return -1;
+  expire(b, now);
+  int64_t used = b->used;
+  if (b->limit - used >= air)
+    return 0;
+  for (const struct duty_burst &e : b->log) {
+    used -= e.air;
+    if (b->limit - used >= air)
+      return e.end + b->window - now;
+  }
+  return 0;
+}
+
+// **********************************************************************
+//      Book a burst of 'air' us that ended at 'now'
+// **********************************************************************
+void duty_charge(struct duty_budget *b, int64_t now, int64_t air)
+{
+  if (b->limit == 0 || air <= 0)
+    return;
+  expire(b, now);
+  b->log.push_back(duty_burst{now, air});
+  b->used += air;
+}
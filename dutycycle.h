@@ -0,0 +1,38 @@
+/*
+	dutycycle.h
+
+	Duty-cycle budget of a transmitter. Many regions limit how long a
+	433 MHz transmitter may be keyed up (e.g. 10% of any hour in the
+	EU). The budget keeps the on-air time of every burst of the last
+	window and tells the transmitter how much it may still send, or how
+	long to wait until a burst fits.
+*/
+#ifndef DUTYCYCLE_H
+#define DUTYCYCLE_H
+
+#include <stdint.h>
+#include <deque>
+
+#define DUTY_CYCLE   10.0	// default limit (percent of the window, 0 = none)
+#define DUTY_WINDOW  3600	// default window (in s)
+#define DUTY_RESERVE 25		// percent of the budget kept for urgent codes
+
+struct duty_burst {
+  int64_t end;            // when the burst ended (us, monotonic clock)
+  int64_t air;            // its on-air time (us)
+};
+
+struct duty_budget {
+  int64_t limit;          // on-air time allowed per window (us, 0 = no limit)
+  int64_t window;         // us
+  int64_t used;           // on-air time of the bursts in 'log'
+  std::deque<struct duty_burst> log;
+};
+
+void    duty_init(struct duty_budget *, double, int);
+int64_t duty_now(void);
+int64_t duty_available(struct duty_budget *, int64_t);
+int64_t duty_wait(struct duty_budget *, int64_t, int64_t);
+void    duty_charge(struct duty_budget *, int64_t, int64_t);
+
+#endif
@@ -0,0 +1,304 @@
+/*
+eventbus.cpp
+
+Shared-memory event ring.
+
+The ring is a file in /dev/shm: a header and EVENTBUS_RECORDS events of
+one cache line each. Event n goes to slot n % EVENTBUS_RECORDS. The
+daemon is the only writer; it clears the sequence number of the slot,
+writes the event, stores the sequence number again and then advances
+'head' (a seqlock per slot). A subscriber reads the slot, checks the
+sequence number before and after, and knows it was overtaken if they
+differ; it then skips ahead and counts the lost events. Readers never
+write to the ring, so they map it read-only and cost the daemon nothing.
+To sleep until the next event a subscriber waits on the 'wake' futex;
+the daemon wakes all waiters with one call per event, however many
+there are.
+
+The Unix socket is served by one more subscriber thread that writes
+every event as a text line to each connected client; a client that
+cannot keep up is dropped. A new client first gets the text of the
+greeting, if one is set (the daemon sends the current plan).
+*/
+
+#include "eventbus.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const size_t bus_bytes = sizeof(struct bus_header) + sizeof(struct bus_event) * EVENTBUS_RECORDS;
+
+static struct bus_header *bus = NULL;     // the daemon's (writable) mapping
+static struct bus_event  *bus_ring = NULL;
+static std::mutex publish_lock;           // sites are planned by several threads at start
+static std::string bus_file;
+
+static long futex(const std::atomic<uint32_t> *addr, int op, uint32_t val, const struct timespec *timeout)
+{
+  return syscall(SYS_futex, addr, op, val, timeout, NULL, 0);
+}
+
+// **********************************************************************
+//      Create (or take over) the ring in 'file'. Events published by an
+//      earlier run are kept and the numbering goes on.
+// **********************************************************************
+int eventbus_open(const char *file)
+{
+  int fd = open(file, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (fd < 0)
+    return 1;
+  fchmod(fd, 0644);
+  if (ftruncate(fd, bus_bytes) != 0) {
+    close(fd);
+    return 1;
+  }
+  void *p = mmap(NULL, bus_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED)
+    return 1;
+
+  bus      = (struct bus_header *) p;
+  bus_ring = (struct bus_event *) (bus + 1);
+  bus_file = file;
+  if (memcmp(bus->magic, EVENTBUS_MAGIC, 8) != 0 || bus->version != EVENTBUS_VERSION ||
+      bus->records != EVENTBUS_RECORDS || bus->record_size != sizeof(struct bus_event)) {
+    memset(p, 0, bus_bytes);
+    bus->version     = EVENTBUS_VERSION;
+    bus->records     = EVENTBUS_RECORDS;
+    bus->record_size = sizeof(struct bus_event);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(bus->magic, EVENTBUS_MAGIC, 8);
+  }
+  return 0;
+}
+
+// **********************************************************************
+//      Publish an event (nothing happens if the ring is not open)
+// **********************************************************************
+void eventbus_publish(int kind, const struct history_record *rec)
+{
+  if (bus == NULL)
+    return;
+  std::lock_guard<std::mutex> lock(publish_lock);
+
+  uint64_t n = bus->head.load(std::memory_order_relaxed);
+  struct bus_event *ev = &bus_ring[n & (EVENTBUS_RECORDS - 1)];
+  ev->seq.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  ev->kind = (uint8_t) kind;
+  ev->rec  = *rec;
+  ev->seq.store(n + 1, std::memory_order_release);
+  bus->head.store(n + 1, std::memory_order_release);
+
+  bus->wake.fetch_add(1, std::memory_order_release);
+  futex(&bus->wake, FUTEX_WAKE, INT_MAX, NULL);
+}
+
+// **********************************************************************
+//      Follow the ring in 'file'; from the oldest event still in it if
+//      'from_start', otherwise from the next one published
+// **********************************************************************
+int eventbus_subscribe(struct bus_subscriber *sub, const char *file, bool from_start)
+{
+  memset(sub, 0, sizeof(*sub));
+  int fd = open(file, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return 1;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t) st.st_size < bus_bytes) {
+    close(fd);
+    return 1;
+  }
+  void *p = mmap(NULL, bus_bytes, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED)
+    return 1;
+
+  sub->hdr  = (const struct bus_header *) p;
+  sub->ring = (const struct bus_event *) (sub->hdr + 1);
+  if (memcmp(sub->hdr->magic, EVENTBUS_MAGIC, 8) != 0 || sub->hdr->version != EVENTBUS_VERSION ||
+      sub->hdr->records != EVENTBUS_RECORDS || sub->hdr->record_size != sizeof(struct bus_event)) {
+    eventbus_unsubscribe(sub);
+    return 1;
+  }
+  uint64_t head = sub->hdr->head.load(std::memory_order_acquire);
+  if (!from_start)
+    sub->next = head;
+  else
+    sub->next = head > EVENTBUS_RECORDS ? head - EVENTBUS_RECORDS : 0;
+  return 0;
+}
+
+// **********************************************************************
+//      Copy the next event to 'out'. Returns 1 if there was one, 0 if
+//      the subscriber has seen everything published so far.
+// **********************************************************************
+int eventbus_read(struct bus_subscriber *sub, struct bus_event *out)
+{
+  for (;;) {
+    uint64_t head = sub->hdr->head.load(std::memory_order_acquire);
+    if (sub->next >= head)
+      return 0;
+    if (head - sub->next > EVENTBUS_RECORDS) {
+      sub->lost += head - EVENTBUS_RECORDS - sub->next;
+      sub->next  = head - EVENTBUS_RECORDS;
+    }
+
+    const struct bus_event *ev = &sub->ring[sub->next & (EVENTBUS_RECORDS - 1)];
+    uint64_t seq = ev->seq.load(std::memory_order_acquire);
+    out->kind = ev->kind;
+    out->rec  = ev->rec;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (seq != sub->next + 1 || ev->seq.load(std::memory_order_relaxed) != seq) {
+      // overwritten while we were reading: the writer is a lap ahead
+      sub->lost++;
+      sub->next++;
+      continue;
+    }
+    out->seq.store(seq, std::memory_order_relaxed);
+    sub->next++;
+    return 1;
+  }
+}
+
+// **********************************************************************
+//      Sleep until an event is published or 'timeout' ms have passed
+//      (-1 = no timeout). Returns 1 if there is something to read.
+// **********************************************************************
+int eventbus_wait(struct bus_subscriber *sub, int timeout)
+{
+  uint32_t wake = sub->hdr->wake.load(std::memory_order_acquire);
+  if (sub->next < sub->hdr->head.load(std::memory_order_acquire))
+    return 1;
+  struct timespec ts = { timeout / 1000, (long) (timeout % 1000) * 1000000 };
+  futex(&sub->hdr->wake, FUTEX_WAIT, wake, timeout < 0 ? NULL : &ts);
+  return sub->next < sub->hdr->head.load(std::memory_order_acquire) ? 1 : 0;
+}
+
+void eventbus_unsubscribe(struct bus_subscriber *sub)
+{
+  if (sub->hdr != NULL)
+    munmap((void *) sub->hdr, bus_bytes);
+  sub->hdr  = NULL;
+  sub->ring = NULL;
+}
+
+// **********************************************************************
+//      An event as a line of text:
+//      seq,kind,time,site,switch,action,cause,planned,transmitters
+// **********************************************************************
+int eventbus_format(const struct bus_event *ev, char *buf, size_t size)
+{
+  const char *kinds[2]  = { "switched", "planned" };
+  const char *causes[4] = { "plan", "restore", "sweep", "remote" };
+  return snprintf(buf, size, "%llu,%s,%lld,%u,%u,%s,%s,%lld,%u\n",
+                  (unsigned long long) (ev->seq.load(std::memory_order_relaxed) - 1),
+                  ev->kind < 2 ? kinds[ev->kind] : "?", (long long) ev->rec.time,
+                  ev->rec.site, ev->rec.sw + 1, ev->rec.action ? "on" : "off",
+                  ev->rec.cause < 4 ? causes[ev->rec.cause] : "?",
+                  (long long) ev->rec.planned, ev->rec.transmitters);
+}
+
+// **********************************************************************
+//      Unix socket: one thread accepts clients, one follows the ring and
+//      sends every event to all of them
+// **********************************************************************
+static std::mutex client_lock;
+static std::vector<int> clients;
+static std::string (*greeting)(void) = NULL;
+
+// **********************************************************************
+//      Text sent to every new client before the events (e.g. the current
+//      plan); called on the socket thread, so it must not block
+// **********************************************************************
+void eventbus_greeting(std::string (*fn)(void))
+{
+  greeting = fn;
+}
+
+static void socket_accept(int lfd)
+{
+  for (;;) {
+    int fd = accept4(lfd, NULL, NULL, SOCK_CLOEXEC);
+    if (fd < 0) {
+      std::this_thread::sleep_for(std::chrono::seconds(1));
+      continue;
+    }
+    shutdown(fd, SHUT_RD);
+    if (greeting != NULL) {
+      std::string text = greeting();
+      if (send(fd, text.data(), text.size(), MSG_NOSIGNAL | MSG_DONTWAIT) != (ssize_t) text.size()) {
+        close(fd);
+        continue;
+      }
+    }
+    std::lock_guard<std::mutex> lock(client_lock);
+    clients.push_back(fd);
+  }
+}
+
+static void socket_fanout(struct bus_subscriber sub)
+{
+  struct bus_event ev;
+  char line [EVENTBUS_LINE];
+  for (;;) {
+    eventbus_wait(&sub, -1);
+    while (eventbus_read(&sub, &ev) == 1) {
+      int len = eventbus_format(&ev, line, sizeof(line));
+      std::lock_guard<std::mutex> lock(client_lock);
+      for (size_t k = 0; k < clients.size(); ) {
+        if (send(clients[k], line, len, MSG_NOSIGNAL | MSG_DONTWAIT) != len) {
+          close(clients[k]);
+          clients.erase(clients.begin() + k);
+        } else {
+          k++;
+        }
+      }
+    }
+  }
+}
+
+// **********************************************************************
+//      Serve the events of the open ring on the Unix socket 'path'
+// **********************************************************************
+int eventbus_serve(const char *path)
+{
+  struct sockaddr_un addr;
+  struct bus_subscriber sub;
+  if (bus == NULL || strlen(path) >= sizeof(addr.sun_path))
+    return 1;
+  if (eventbus_subscribe(&sub, bus_file.c_str(), false) != 0)
+    return 1;
+
+  int lfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (lfd < 0)
+    return 1;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+  unlink(path);
+  if (bind(lfd, (struct sockaddr *) &addr, sizeof(addr)) != 0 || listen(lfd, 8) != 0) {
+    close(lfd);
+    eventbus_unsubscribe(&sub);
+    return 1;
+  }
+  chmod(path, 0666);
+
+  std::thread(socket_accept, lfd).detach();
+  std::thread(socket_fanout, sub).detach();
+  return 0;
+}
@@ -0,0 +1,73 @@
+/*
+	eventbus.h
+
+	Local publish/subscribe of switching events. The daemon writes every
+	state change and every planned change once into a ring buffer in
+	shared memory; subscribers map the ring read-only and follow it with
+	a cursor of their own, so the daemon neither knows nor pays for the
+	number of readers. Clients that cannot map the ring get the same
+	events as text lines on a Unix socket, served by one more subscriber.
+*/
+#ifndef EVENTBUS_H
+#define EVENTBUS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <string>
+#include "history.h"
+
+#define EVENTBUS_FILE    "/dev/shm/lights433.events"
+#define EVENTBUS_SOCKET  "/run/lights433.sock"
+#define EVENTBUS_RECORDS 1024		// events kept in the ring (power of two)
+#define EVENTBUS_MAGIC   "L433EVTS"
+#define EVENTBUS_VERSION 1
+#define EVENTBUS_LINE    160		// longest text line of an event
+
+// Kinds of event
+#define BUS_SWITCHED 0		// a code was sent or received (as in the history)
+#define BUS_PLANNED  1		// a change was planned for rec.planned
+
+struct bus_event {
+  std::atomic<uint64_t> seq;    // sequence number + 1 (0 while being written)
+  uint8_t  kind;                // BUS_*
+  uint8_t  reserved[7];
+  struct history_record rec;
+  uint8_t  pad[16];             // one cache line per event
+};
+
+struct bus_header {
+  char     magic[8];
+  uint32_t version;
+  uint32_t records;             // size of the ring
+  uint32_t record_size;
+  std::atomic<uint32_t> wake;   // futex, bumped on every publish
+  std::atomic<uint64_t> head;   // number of events published
+  uint8_t  pad[32];
+};
+
+// A reader of the ring
+struct bus_subscriber {
+  const struct bus_header *hdr;
+  const struct bus_event  *ring;
+  uint64_t next;                // sequence number of the next event to read
+  uint64_t lost;                // events overwritten before they were read
+};
+
+static_assert(sizeof(struct bus_event) == 64, "bus_event is one cache line");
+static_assert(sizeof(struct bus_header) == 64, "bus_header is one cache line");
+
+// publisher (the daemon)
+int  eventbus_open(const char *);
+void eventbus_publish(int, const struct history_record *);
+int  eventbus_serve(const char *);
+void eventbus_greeting(std::string (*)(void));
+
+// subscribers
+int  eventbus_subscribe(struct bus_subscriber *, const char *, bool);
+int  eventbus_read(struct bus_subscriber *, struct bus_event *);
+int  eventbus_wait(struct bus_subscriber *, int);
+void eventbus_unsubscribe(struct bus_subscriber *);
+int  eventbus_format(const struct bus_event *, char *, size_t);
+
+#endif
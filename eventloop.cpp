@@ -0,0 +1,164 @@
+/*
+eventloop.cpp 
+
+Single-threaded event loop driving the coroutines in lights433. 
+
+Suspended coroutines are kept in a timer heap (delay) or wait for their
+frame to be sent by the transmitter threads (transmit), which report back
+with loop_post(). The loop sleeps until the next timer or posted work, so 
+many concurrent sequences cost one thread and no stacks of their own.
+*/
+
+#include "lights433.h"
+#include <queue>
+#include <map>
+#include <memory>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+
+typedef std::chrono::steady_clock::time_point time_point;
+
+struct timer {
+  time_point when;
+  unsigned long seq;              // keeps timers with equal deadline in order
+  std::coroutine_handle<> h;
+  bool operator>(const timer &t) const {
+    return when > t.when || (when == t.when && seq > t.seq);
+  }
+};
+
+static std::priority_queue<timer, std::vector<timer>, std::greater<timer> > timers;
+static unsigned long timer_seq = 0;
+static int outstanding = 0;          // coroutines waiting for a transmission
+static std::map<int, int> in_flight; // codes being transmitted (code -> count)
+
+// Work posted from other threads (e.g. the receiver), run on the loop thread
+static std::mutex posted_lock;
+static std::condition_variable posted_cv;
+static std::vector<std::function<void()> > posted;
+
+// Free coroutine frames by size class (loop thread only)
+struct free_frame { struct free_frame *next; };
+static struct free_frame *free_frames [FRAME_MAX / FRAME_CLASS];
+
+// **********************************************************************
+//      Coroutine frames: a freed frame is kept for the next coroutine
+//      of the same size class instead of going back to the heap
+// **********************************************************************
+void *frame_alloc(size_t n)
+{
+  size_t c = (n + FRAME_CLASS - 1) / FRAME_CLASS - 1;
+  if (c >= FRAME_MAX / FRAME_CLASS)
+    return ::operator new(n);
+  if (free_frames[c] == nullptr)
+    return ::operator new((c + 1) * FRAME_CLASS);
+  struct free_frame *f = free_frames[c];
+  free_frames[c] = f->next;
+  return f;
+}
+
+void frame_free(void *p, size_t n)
+{
+  size_t c = (n + FRAME_CLASS - 1) / FRAME_CLASS - 1;
+  if (c >= FRAME_MAX / FRAME_CLASS) {
+    ::operator delete(p);
+    return;
+  }
+  struct free_frame *f = (struct free_frame *) p;
+  f->next = free_frames[c];
+  free_frames[c] = f;
+}
+
+void delay_awaiter::await_suspend(std::coroutine_handle<> h)
+{
+  timers.push(timer{std::chrono::steady_clock::now() + std::chrono::milliseconds(ms), timer_seq++, h});
+}
+
+// **********************************************************************
+//      Queue the frame on every selected transmitter; resume the 
+//      coroutine on the loop thread once all of them have sent it.
+//      Selects no transmitter that exists: resumes it right away.
+// **********************************************************************
+bool transmit_awaiter::await_suspend(std::coroutine_handle<> h)
+{
+  unsigned int mask = transmitters & transmitter_all();
+  if (mask == 0)
+    return false;
+  std::shared_ptr<int> remaining = std::make_shared<int>(0);
+  int c = code;
+
+  outstanding += 1;
+  in_flight[c] += 1;
+  for (int i = 0; i < transmitter_count(); i++) {
+    if (mask & (1u << i))
+      *remaining += 1;
+  }
+  for (int i = 0; i < transmitter_count(); i++) {
+    if (!(mask & (1u << i)))
+      continue;
+    transmitter_queue(i, c, repeats, urgent, [remaining, c, h] {
+      loop_post([remaining, c, h] {
+        if (--*remaining > 0)
+          return;
+        outstanding -= 1;
+        if (--in_flight[c] == 0)
+          in_flight.erase(c);
+        h.resume();
+      });
+    });
+  }
+  return true;
+}
+
+// Is 'code' being transmitted right now?
+bool transmit_in_flight(int code)
+{
+  return in_flight.count(code) > 0;
+}
+
+// **********************************************************************
+//      Run 'fn' on the loop thread. Safe to call from any thread.
+// **********************************************************************
+void loop_post(std::function<void()> fn)
+{
+  std::lock_guard<std::mutex> guard(posted_lock);
+  posted.push_back(std::move(fn));
+  posted_cv.notify_one();
+}
+
+// **********************************************************************
+//      Run until no coroutine is waiting any more
+// **********************************************************************
+void loop_run(void)
+{
+  std::vector<std::function<void()> > work;
+
+  while (!timers.empty() || outstanding > 0) {
+    // run work posted by other threads
+    {
+      std::lock_guard<std::mutex> guard(posted_lock);
+      work.swap(posted);
+    }
+    for (std::function<void()> &fn : work)
+      fn();
+    work.clear();
+
+    time_point now = std::chrono::steady_clock::now();
+
+    // resume every coroutine whose timer has expired
+    if (!timers.empty() && timers.top().when <= now) {
+      std::coroutine_handle<> h = timers.top().h;
+      timers.pop();
+      h.resume();
+      continue;
+    }
+
+    // nothing is due: sleep until the next event
+    time_point next = time_point::max();
+    if (!timers.empty())
+      next = timers.top().when;
+    std::unique_lock<std::mutex> guard(posted_lock);
+    posted_cv.wait_until(guard, next, [] { return !posted.empty(); });
+  }
+}
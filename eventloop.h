@@ -0,0 +1,142 @@
+/* 
+	eventloop.h
+
+	Single-threaded coroutine runtime. Schedule actions are written as
+	coroutines returning a 'task' and suspend with
+
+	  co_await delay(ms);             // resume after ms milliseconds
+	  co_await transmit(code, mask);  // resume once the code has been sent
+	                                  // on every transmitter in mask
+	  if (co_await cancelled()) ...   // task::cancel() was called
+
+	Any number of tasks run concurrently on the thread calling loop_run().
+	Frames are handed to the transmitters' queues (see transmitter.h).
+*/
+#ifndef EVENTLOOP_H
+#define EVENTLOOP_H
+
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <stddef.h>
+
+#define FRAME_CLASS 64		// coroutine frames are recycled in multiples of this size
+#define FRAME_MAX   2048	// larger frames come from the heap every time
+
+void *frame_alloc(size_t);
+void  frame_free(void *, size_t);
+
+// **********************************************************************
+//      Coroutine task. Starts running immediately; may be co_await'ed
+//      once to wait for its completion. A task whose object is destroyed
+//      before it finishes keeps running and cleans up after itself.
+//      cancel() asks it to stop: a task that can be cancelled checks
+//      'co_await cancelled()' whenever it resumes.
+// **********************************************************************
+class task {
+public:
+  struct promise_type;
+  typedef std::coroutine_handle<promise_type> handle;
+
+  struct promise_type {
+    std::coroutine_handle<> continuation;
+    bool detached  = false;
+    bool cancelled = false;
+
+    // frames are recycled, so a running schedule does not touch the heap
+    static void *operator new(size_t n) { return frame_alloc(n); }
+    static void operator delete(void *p, size_t n) { frame_free(p, n); }
+
+    task get_return_object() { return task(handle::from_promise(*this)); }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+
+    struct final_awaiter {
+      bool await_ready() noexcept { return false; }
+      std::coroutine_handle<> await_suspend(handle h) noexcept {
+        std::coroutine_handle<> next = h.promise().continuation;
+        if (h.promise().detached)
+          h.destroy();
+        return next ? next : std::noop_coroutine();
+      }
+      void await_resume() noexcept {}
+    };
+    final_awaiter final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+
+  task() : h(nullptr) {}
+  task(task &&t) : h(t.h) { t.h = nullptr; }
+  task(const task &) = delete;
+  task &operator=(task &&t) {
+    release();
+    h = t.h;
+    t.h = nullptr;
+    return *this;
+  }
+  ~task() { release(); }
+
+  bool done() const { return !h || h.done(); }
+  void cancel() {
+    if (!done())
+      h.promise().cancelled = true;
+  }
+
+  bool await_ready() { return h.done(); }
+  void await_suspend(std::coroutine_handle<> c) { h.promise().continuation = c; }
+  void await_resume() {}
+
+private:
+  explicit task(handle hh) : h(hh) {}
+  void release() {
+    if (!h) 
+      return;
+    if (h.done())
+      h.destroy();
+    else
+      h.promise().detached = true;
+    h = nullptr;
+  }
+  handle h;
+};
+
+// **********************************************************************
+//      Awaitables
+// **********************************************************************
+struct delay_awaiter {
+  int ms;
+  bool await_ready() { return ms <= 0; }
+  void await_suspend(std::coroutine_handle<> h);
+  void await_resume() {}
+};
+
+struct transmit_awaiter {
+  int code;
+  unsigned int transmitters;    // bit mask of the transmitters to send on
+  int repeats;                  // frames to send (0 = the transmitter's)
+  bool urgent;                  // false: may wait for airtime
+  bool await_ready() { return transmitters == 0; }
+  bool await_suspend(std::coroutine_handle<> h);
+  void await_resume() {}
+};
+
+// Whether the task was cancelled (never suspends)
+struct cancelled_awaiter {
+  bool value;
+  bool await_ready() { return false; }
+  bool await_suspend(task::handle h) { value = h.promise().cancelled; return false; }
+  bool await_resume() { return value; }
+};
+
+inline delay_awaiter    delay(int ms)      { return delay_awaiter{ms}; }
+inline cancelled_awaiter cancelled()       { return cancelled_awaiter{false}; }
+inline transmit_awaiter transmit(int code, unsigned int transmitters, int repeats = 0, bool urgent = true) 
+{ 
+  return transmit_awaiter{code, transmitters, repeats, urgent}; 
+}
+
+void loop_run(void);
+void loop_post(std::function<void()>);
+bool transmit_in_flight(int);
+
+#endif
@@ -0,0 +1,86 @@
+/*
+fastmath.cpp 
+
+Accuracy and speed check of the fast solar kernel (AstroCalc4RFast)
+against the libm reference (AstroCalc4R).
+
+Sunrise and sunset are compared for every day of a full leap-year cycle,
+at every whole degree of latitude from 89 S to 89 N and at several
+longitudes. The check fails if any time differs by more than the error
+budget, or if only one kernel has no sunrise or sunset (polar day or
+night) on a day.
+*/
+
+#include "AstroCalc4R.h"
+#include <chrono>
+#include <vector>
+
+// **********************************************************************
+//      Compare both kernels. Returns 0 if within 'budget' seconds.
+// **********************************************************************
+int fastmath_check(double budget)
+{
+  std::vector<int>    day, month, year;
+  std::vector<double> hhour, xlat, xlon;
+
+  for (int y = 2024; y <= 2027; y++)
+    for (int m = 1; m <= 12; m++)
+      for (int d = 1; d <= daymonth(m, y); d++)
+        for (int lat = -89; lat <= 89; lat++)
+          for (int lon = -180; lon < 180; lon += 45) {
+            day.push_back(d);
+            month.push_back(m);
+            year.push_back(y);
+            hhour.push_back(12.0);
+            xlat.push_back(lat);
+            xlon.push_back(lon);
+          }
+
+  int nrec  = (int) day.size();
+  int tzone = 0;
+  std::vector<double> noon(nrec), azimuth(nrec), zenith(nrec), eqtime(nrec), declin(nrec), daylength(nrec), par(nrec);
+  std::vector<double> rise_ref(nrec), set_ref(nrec), rise_fast(nrec), set_fast(nrec);
+
+  auto t0 = std::chrono::steady_clock::now();
+  AstroCalc4R(&nrec, &tzone, day.data(), month.data(), year.data(), hhour.data(), xlat.data(), xlon.data(),
+              noon.data(), rise_ref.data(), set_ref.data(), azimuth.data(), zenith.data(),
+              eqtime.data(), declin.data(), daylength.data(), par.data());
+  auto t1 = std::chrono::steady_clock::now();
+  AstroCalc4RFast(&nrec, &tzone, day.data(), month.data(), year.data(), hhour.data(), xlat.data(), xlon.data(),
+              noon.data(), rise_fast.data(), set_fast.data(), azimuth.data(), zenith.data(),
+              eqtime.data(), declin.data(), daylength.data(), par.data());
+  auto t2 = std::chrono::steady_clock::now();
+
+  double max_err = 0, sum_err = 0;
+  int n = 0, polar = 0, disagree = 0;
+  for (int i = 0; i < nrec; i++) {
+    // no sunrise/sunset (polar day or night): both kernels must say so
+    bool none_ref  = isnan(rise_ref[i])  || isnan(set_ref[i]);
+    bool none_fast = isnan(rise_fast[i]) || isnan(set_fast[i]);
+    if (none_ref != none_fast) {
+      if (disagree++ < 5)
+        printf("polar mismatch: %04d-%02d-%02d lat %g lon %g (%s has no sunrise/sunset)\n", year[i], month[i],
+               day[i], xlat[i], xlon[i], none_ref ? "libm" : "fast");
+      continue;
+    }
+    if (none_ref) {
+      polar += 1;
+      continue;
+    }
+    double e = 3600.0 * fmax(fabs(rise_ref[i] - rise_fast[i]), fabs(set_ref[i] - set_fast[i]));
+    max_err  = fmax(max_err, e);
+    sum_err += e;
+    n += 1;
+  }
+
+  double t_ref  = std::chrono::duration<double>(t1 - t0).count();
+  double t_fast = std::chrono::duration<double>(t2 - t1).count();
+  printf("records:        %d (%d with sunrise/sunset, %d polar day or night)\n", nrec, n, polar);
+  printf("polar mismatch: %d\n", disagree);
+  printf("max error:      %.4f s (budget %.1f s)\n", max_err, budget);
+  printf("mean error:     %.6f s\n", n ? sum_err / n : 0.0);
+  printf("libm kernel:    %.1f ns/record\n", 1e9 * t_ref / nrec);
+  printf("fast kernel:    %.1f ns/record (%.2fx)\n", 1e9 * t_fast / nrec, t_ref / t_fast);
+
+  return max_err <= budget && disagree == 0 ? 0 : 1;
+}
@@ -0,0 +1,170 @@
+/* 
+	fastmath.h
+
+	Polynomial approximations of the libm functions used by AstroCalc4R.
+	The solar pipeline only needs sunrise/sunset to within a few seconds,
+	so these trade the last digits of precision for speed. All functions
+	are inline and free of branches and table lookups, so batched loops
+	over arrays of dates or positions auto-vectorize (NEON, SSE/AVX).
+
+	Accuracy (absolute error) is about 1e-7 or better over the ranges 
+	used by the solar calculations, i.e. well below a second of time;
+	'lights433 mathcheck' verifies the resulting sunrise/sunset times
+	against the libm reference.
+*/
+#ifndef FASTMATH_H
+#define FASTMATH_H
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#define FM_PI      3.14159265358979323846
+#define FM_PI_2    1.57079632679489661923
+#define FM_2_PI    0.63661977236758134308
+#define FM_LN2     0.69314718055994530942
+#define FM_LOG2E   1.44269504088896340736
+// pi/2 split in two parts for an exact range reduction (Cody-Waite)
+#define FM_PI_2_HI 1.57079632673412561417
+#define FM_PI_2_LO 6.07710050650619224932e-11
+
+// Round to nearest integer. A conversion instruction on every target, 
+// where floor() may be a library call.
+static inline int64_t fm_round(double x) { return (int64_t) (x + (x < 0 ? -0.5 : 0.5)); }
+
+// **********************************************************************
+//      Polynomials on the reduced range [-pi/4, pi/4]
+// **********************************************************************
+static inline double fm_sin_poly(double r)
+{
+  double r2 = r * r;
+  return r + r * r2 * (-1.0/6 + r2 * (1.0/120 + r2 * (-1.0/5040 + r2 * (1.0/362880))));
+}
+
+static inline double fm_cos_poly(double r)
+{
+  double r2 = r * r;
+  return 1.0 + r2 * (-0.5 + r2 * (1.0/24 + r2 * (-1.0/720 + r2 * (1.0/40320 
+               + r2 * (-1.0/3628800)))));
+}
+
+// **********************************************************************
+//      sin and cos of x, both computed from one range reduction
+// **********************************************************************
+static inline void fm_sincos(double x, double *s, double *c)
+{
+  int64_t n = fm_round(x * FM_2_PI);
+  double  k = (double) n;
+  double  r = (x - k * FM_PI_2_HI) - k * FM_PI_2_LO;
+  int     q = (int) (n & 3);                           // quadrant 0..3
+  double  sp = fm_sin_poly(r);
+  double  cp = fm_cos_poly(r);
+  double  sv = (q & 1) ? cp : sp;
+  double  cv = (q & 1) ? sp : cp;
+  *s = (q & 2) ? -sv : sv;
+  *c = ((q + 1) & 2) ? -cv : cv;
+}
+
+static inline double fm_sin(double x) { double s, c; fm_sincos(x, &s, &c); return s; }
+static inline double fm_cos(double x) { double s, c; fm_sincos(x, &s, &c); return c; }
+static inline double fm_tan(double x) { double s, c; fm_sincos(x, &s, &c); return s / c; }
+
+// **********************************************************************
+//      asin/acos. On |x| > 0.5 use asin(x) = pi/2 - 2 asin(sqrt((1-x)/2))
+//      so the series is only evaluated on [0, 0.5].
+// **********************************************************************
+static inline double fm_asin_poly(double x)
+{
+  // Taylor series, coefficients (2n)! / (4^n (n!)^2 (2n+1))
+  double x2 = x * x;
+  return x + x * x2 * (0.16666666666666666 + x2 * (0.075 + x2 * (0.044642857142857144
+           + x2 * (0.030381944444444444 + x2 * (0.022372159090909092 
+           + x2 * (0.017352764423076924 + x2 * (0.01396484375 
+           + x2 * (0.011551800896139705 + x2 * 0.009761609529194078))))))));
+}
+
+static inline double fm_asin(double x)
+{
+  double a     = fabs(x);
+  double big   = FM_PI_2 - 2.0 * fm_asin_poly(sqrt((1.0 - a) * 0.5));
+  double small = fm_asin_poly(a);
+  double r     = a > 0.5 ? big : small;
+  // asin(x) is NaN outside [-1, 1], like libm
+  return a > 1.0 ? NAN : (x < 0 ? -r : r);
+}
+
+static inline double fm_acos(double x) { return FM_PI_2 - fm_asin(x); }
+
+// **********************************************************************
+//      exp(x) = 2^k exp(r), |r| <= ln2/2
+// **********************************************************************
+static inline double fm_exp(double x)
+{
+  x = x < -708.0 ? -708.0 : (x > 709.0 ? 709.0 : x);
+  double k = (double) fm_round(x * FM_LOG2E);
+  double r = x - k * FM_LN2;
+  double p = 1.0 + r * (1.0 + r * (1.0/2 + r * (1.0/6 + r * (1.0/24 + r * (1.0/120 
+               + r * (1.0/720 + r * (1.0/5040 + r * (1.0/40320))))))));
+  uint64_t bits = (uint64_t) ((int64_t) k + 1023) << 52;
+  double scale;
+  memcpy(&scale, &bits, sizeof(scale));
+  return p * scale;
+}
+
+// **********************************************************************
+//      log(x) for x > 0: x = m 2^e with m in [sqrt(1/2), sqrt(2)), 
+//      log(m) = 2 atanh((m-1)/(m+1))
+// **********************************************************************
+static inline double fm_log(double x)
+{
+  uint64_t bits;
+  memcpy(&bits, &x, sizeof(bits));
+  int64_t e = (int64_t) ((bits >> 52) & 0x7FF) - 1023;
+  bits = (bits & 0x000FFFFFFFFFFFFFull) | 0x3FF0000000000000ull;
+  double m;
+  memcpy(&m, &bits, sizeof(m));
+  bool hi = m > 1.41421356237309504880;
+  m = hi ? m * 0.5 : m;
+  e = hi ? e + 1 : e;
+
+  double s  = (m - 1.0) / (m + 1.0);
+  double s2 = s * s;
+  double l  = 2.0 * s * (1.0 + s2 * (1.0/3 + s2 * (1.0/5 + s2 * (1.0/7 + s2 * (1.0/9 
+                + s2 * (1.0/11))))));
+  return l + (double) e * FM_LN2;
+}
+
+// pow(x, y) for x > 0 (all the solar code needs)
+static inline double fm_pow(double x, double y) { return fm_exp(y * fm_log(x)); }
+
+// fmod(x, y): remainder with the sign of x, like libm
+static inline double fm_fmod(double x, double y) { return x - y * (double) (int64_t) (x / y); }
+
+// **********************************************************************
+//      Math policies for the templated solar kernel
+// **********************************************************************
+struct libm_math {
+  static double sin (double x)           { return ::sin(x); }
+  static double cos (double x)           { return ::cos(x); }
+  static double tan (double x)           { return ::tan(x); }
+  static double asin(double x)           { return ::asin(x); }
+  static double acos(double x)           { return ::acos(x); }
+  static double exp (double x)           { return ::exp(x); }
+  static double pow (double x, double y) { return ::pow(x, y); }
+  static double fmod(double x, double y) { return ::fmod(x, y); }
+};
+
+struct fast_math {
+  static double sin (double x)           { return fm_sin(x); }
+  static double cos (double x)           { return fm_cos(x); }
+  static double tan (double x)           { return fm_tan(x); }
+  static double asin(double x)           { return fm_asin(x); }
+  static double acos(double x)           { return fm_acos(x); }
+  static double exp (double x)           { return fm_exp(x); }
+  static double pow (double x, double y) { return fm_pow(x, y); }
+  static double fmod(double x, double y) { return fm_fmod(x, y); }
+};
+
+int fastmath_check(double);
+
+#endif
@@ -0,0 +1,179 @@
+/*
+history.cpp 
+
+Append-only event history store.
+
+Segment files are named 00000000.seg, 00000001.seg, ... and preallocated 
+to HISTORY_SEGMENT_RECORDS records, so an empty slot reads as zeros and
+the number of records is found by binary search on open. For every 
+segment the time of each HISTORY_INDEX_STRIDE-th record is kept in memory
+(the sparse index); a query skips segments outside the range, finds the
+first block with a binary search on the index and scans from there.
+Records are appended by the daemon only, normally in time order; after
+the clock was set back (NTP on a Pi without a real-time clock) a
+segment is out of order, and a query scans all of it instead.
+*/
+
+#include "history.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+struct segment {
+  struct history_record *records;   // mapped file
+  long count;                        // records in use
+  bool ordered;                      // times never decrease (the index can be used)
+  std::vector<int64_t> index;        // time of every HISTORY_INDEX_STRIDE-th record
+};
+
+static std::string history_dir;
+static std::vector<struct segment> segments;
+static bool writable = false;
+
+static const size_t segment_bytes = sizeof(struct history_record) * HISTORY_SEGMENT_RECORDS;
+
+static std::string segment_name(size_t n)
+{
+  char name [32];
+  snprintf(name, sizeof(name), "/%08zu.seg", n);
+  return history_dir + name;
+}
+
+// **********************************************************************
+//      Map segment file n (creating it if 'create') and index it
+// **********************************************************************
+static int segment_map(size_t n, bool create)
+{
+  std::string name = segment_name(n);
+  int fd = open(name.c_str(), writable ? (O_RDWR | (create ? O_CREAT : 0)) : O_RDONLY, 0644);
+  if (fd < 0)
+    return 1;
+  if (create && ftruncate(fd, segment_bytes) != 0) {
+    close(fd);
+    return 1;
+  }
+  void *p = mmap(NULL, segment_bytes, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED)
+    return 1;
+
+  struct segment seg;
+  seg.records = (struct history_record *) p;
+
+  // number of records: first empty slot
+  long lo = 0, hi = HISTORY_SEGMENT_RECORDS;
+  while (lo < hi) {
+    long mid = (lo + hi) / 2;
+    if (seg.records[mid].time != 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  seg.count = lo;
+  seg.ordered = true;
+  for (long i = 0; i < seg.count; i++) {
+    if (i % HISTORY_INDEX_STRIDE == 0)
+      seg.index.push_back(seg.records[i].time);
+    if (i > 0 && seg.records[i].time < seg.records[i - 1].time)
+      seg.ordered = false;
+  }
+
+  segments.push_back(seg);
+  return 0;
+}
+
+// **********************************************************************
+//      Open the store in 'dir'. Only the daemon opens it 'for_append'.
+// **********************************************************************
+int history_open(const char *dir, bool for_append)
+{
+  history_dir = dir;
+  writable    = for_append;
+  if (for_append) {
+    mkdir(history_dir.substr(0, history_dir.rfind('/')).c_str(), 0755);
+    mkdir(dir, 0755);
+  }
+
+  size_t n = 0;
+  while (access(segment_name(n).c_str(), F_OK) == 0) {
+    if (segment_map(n, false) != 0)
+      return 1;
+    n++;
+  }
+  if (for_append && segments.empty())
+    return segment_map(0, true);
+  return 0;
+}
+
+// **********************************************************************
+//      Append a record
+// **********************************************************************
+int history_append(const struct history_record *rec)
+{
+  if (!writable || segments.empty())
+    return 1;
+  if (segments.back().count == HISTORY_SEGMENT_RECORDS && segment_map(segments.size(), true) != 0)
+    return 1;
+
+  struct segment &seg = segments.back();
+  if (seg.count > 0 && rec->time < seg.records[seg.count - 1].time)
+    seg.ordered = false;
+  seg.records[seg.count] = *rec;
+  if (seg.count % HISTORY_INDEX_STRIDE == 0)
+    seg.index.push_back(rec->time);
+  seg.count += 1;
+  return 0;
+}
+
+// **********************************************************************
+//      Visit every record with from <= time < to (of the site with id
+//      'site' and switch 'sw'; < 0 for all) in the order they were stored (time
+//      order unless the clock was set back). Returns the number visited.
+// **********************************************************************
+long history_query(time_t from, time_t to, int64_t site, int sw, history_visitor visit)
+{
+  long n = 0;
+  for (struct segment &seg : segments) {
+    if (seg.count == 0)
+      continue;
+    if (!seg.ordered) {
+      for (long i = 0; i < seg.count; i++) {
+        const struct history_record &r = seg.records[i];
+        if (r.time >= from && r.time < to && (site < 0 || r.site == site) && (sw < 0 || r.sw == sw)) {
+          visit(r);
+          n++;
+        }
+      }
+      continue;
+    }
+    if (seg.records[seg.count - 1].time < from || seg.records[0].time >= to)
+      continue;
+
+    // last indexed block starting before 'from'
+    size_t block = std::lower_bound(seg.index.begin(), seg.index.end(), (int64_t) from) - seg.index.begin();
+    long i = block > 0 ? (long) (block - 1) * HISTORY_INDEX_STRIDE : 0;
+
+    for (; i < seg.count && seg.records[i].time < to; i++) {
+      const struct history_record &r = seg.records[i];
+      if (r.time >= from && (site < 0 || r.site == site) && (sw < 0 || r.sw == sw)) {
+        visit(r);
+        n++;
+      }
+    }
+  }
+  return n;
+}
+
+void history_close(void)
+{
+  for (struct segment &seg : segments)
+    munmap(seg.records, segment_bytes);
+  segments.clear();
+}
@@ -0,0 +1,44 @@
+/* 
+	history.h
+
+	Append-only event history. Every switching event is stored as a 
+	fixed-size binary record in memory-mapped segment files. A sparse
+	in-memory index of the record times makes time-range queries over
+	years of events a matter of a binary search and a short scan.
+*/
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdint.h>
+#include <time.h>
+#include <functional>
+
+#define HISTORY_DIR             "/var/lib/lights433/history"
+#define HISTORY_SEGMENT_RECORDS 65536	// records per segment file (2 MB)
+#define HISTORY_INDEX_STRIDE    256	// one index entry per this many records
+
+// Causes of an event
+#define HIST_PLAN     0		// planned on/off time
+#define HIST_RESTORE  1		// reconciled with the plan after a restart
+#define HIST_SWEEP    2		// all-off sweep at start
+#define HIST_REMOTE   3		// press on the remote, seen by the receiver
+
+struct history_record {
+  int64_t  time;          // when it happened (0 = empty slot)
+  int64_t  planned;       // planned time of the change (0 = not planned)
+  uint32_t transmitters;  // transmitters the code was sent on
+  uint32_t site;          // id of the site (site_hash() of its name), stable across restarts
+  uint8_t  sw;            // switch index
+  uint8_t  action;        // LIGHTS_ON or LIGHTS_OFF
+  uint8_t  cause;         // HIST_*
+  uint8_t  reserved[5];
+};
+
+typedef std::function<void(const struct history_record &)> history_visitor;
+
+int  history_open(const char *, bool);
+int  history_append(const struct history_record *);
+long history_query(time_t, time_t, int64_t, int, history_visitor);
+void history_close(void);
+
+#endif
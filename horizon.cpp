@@ -0,0 +1,89 @@
+/*
+horizon.cpp
+
+Rolling plan horizon.
+
+A horizon is the output of plan_days() for a short range of days, kept
+as it is. Days are looked up by index, and a night whose off time is
+after midnight stays with the date it started on, so the intervals of
+yesterday still tell whether a switch is on in the small hours.
+
+Extending the horizon runs on one planner thread, started on the first
+request. Requests are done in order; the callback gets the new horizon
+on that thread and passes it on (the daemon posts it to the event
+loop, which swaps it in).
+*/
+
+#include "horizon.h"
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+struct horizon_work {
+  struct horizon_job *job;
+  std::function<void(struct plan_horizon *)> done;
+};
+
+static std::mutex work_lock;
+static std::condition_variable work_cv;
+static std::vector<struct horizon_work> work;
+static bool planner_running = false;
+
+// **********************************************************************
+//      The plan of the days of a job
+// **********************************************************************
+struct plan_horizon *horizon_run(struct horizon_job *job)
+{
+  struct day_calendar *cal = &job->calendar;
+  if (!cal->rules.empty() && (job->first < cal->first || job->last > cal->last))
+    daycal_compile(cal, job->first, job->last);
+
+  struct plan_horizon *h = new struct plan_horizon;
+  h->first = job->first;
+  h->last  = job->last;
+  h->built = time(NULL);
+  h->days.reserve(job->last - job->first + 1);
+  plan_days(&job->site, job->first, job->last, [h](const struct plan_day *days, int n) {
+    h->days.insert(h->days.end(), days, days + n);
+  });
+  return h;
+}
+
+// The plan of day d, or NULL if it is outside the horizon
+const struct plan_day *horizon_day(const struct plan_horizon *h, int32_t d)
+{
+  if (h == NULL || d < h->first || d > h->last)
+    return NULL;
+  return &h->days[d - h->first];
+}
+
+static void planner(void)
+{
+  while (1) {
+    struct horizon_work w;
+    {
+      std::unique_lock<std::mutex> lock(work_lock);
+      work_cv.wait(lock, [] { return !work.empty(); });
+      w = std::move(work.front());
+      work.erase(work.begin());
+    }
+    struct plan_horizon *h = horizon_run(w.job);
+    delete w.job;
+    w.done(h);
+  }
+}
+
+// **********************************************************************
+//      Build the horizon of 'job' on the planner thread and call 'done'
+//      with it there. Takes over the job.
+// **********************************************************************
+void horizon_request(struct horizon_job *job, std::function<void(struct plan_horizon *)> done)
+{
+  std::lock_guard<std::mutex> lock(work_lock);
+  work.push_back(horizon_work{job, std::move(done)});
+  if (!planner_running) {
+    planner_running = true;
+    std::thread(planner).detach();
+  }
+  work_cv.notify_one();
+}
@@ -0,0 +1,45 @@
+/*
+	horizon.h
+
+	Rolling plan horizon: the resolved plan (sunrise, sunset, on/off
+	intervals of every switch) of a site from yesterday until
+	HORIZON_DAYS ahead. It is built with plan_days(), on the planner
+	thread when it runs low, so that moving to the next day only looks
+	the day up. Each horizon is immutable once built; the control loop
+	swaps in the new one as a whole.
+*/
+#ifndef HORIZON_H
+#define HORIZON_H
+
+#include "planexport.h"
+#include "daycal.h"
+#include <stdint.h>
+#include <time.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+#define HORIZON_DAYS   7	// days planned ahead of today
+#define HORIZON_REFILL 3	// extended when fewer days than this are left
+
+struct plan_horizon {
+  int32_t first, last;              // days planned
+  time_t  built;
+  std::vector<struct plan_day> days;   // day d is days[d - first]
+};
+
+// A copy of everything a horizon depends on, so that it can be built on
+// another thread while the site changes. site.name and site.calendar
+// point to the name and calendar of the job.
+struct horizon_job {
+  struct plan_site site;
+  std::string name;
+  struct day_calendar calendar;
+  int32_t first, last;
+};
+
+struct plan_horizon *horizon_run(struct horizon_job *);
+const struct plan_day *horizon_day(const struct plan_horizon *, int32_t);
+void horizon_request(struct horizon_job *, std::function<void(struct plan_horizon *)>);
+
+#endif
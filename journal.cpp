@@ -0,0 +1,150 @@
+/*
+journal.cpp 
+
+Crash-safe state journal. 
+
+The journal file holds JOURNAL_SLOTS fixed-size records. An update never
+overwrites the current record: the new record is written to the other slot,
+checksummed and flushed with msync(). If power fails half way, the torn slot
+fails its checksum and the previous record is used on the next start. Each
+slot starts a page of its own (JOURNAL_PAGE), so an SD card that rewrites a
+whole sector or flash page on a torn write cannot take the other slot with
+it.
+*/
+
+#include "journal.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stddef.h>
+#include <string.h>
+
+// **********************************************************************
+//      CRC-32 (IEEE 802.3), bitwise. Records are tiny and rarely written.
+// **********************************************************************
+static uint32_t crc32(const void *data, size_t len)
+{
+  const uint8_t *p = (const uint8_t *) data;
+  uint32_t crc = 0xFFFFFFFF;
+  while (len--) {
+    crc ^= *p++;
+    for (int k = 0; k < 8; k++)
+      crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+  }
+  return ~crc;
+}
+
+static struct journal_record *slot(struct journal *j, int i)
+{
+  return (struct journal_record *) (j->slots + (size_t) i * JOURNAL_PAGE);
+}
+
+static bool record_valid(const struct journal_record *r)
+{
+  return r->magic == JOURNAL_MAGIC &&
+         r->crc == crc32(r, offsetof(struct journal_record, crc));
+}
+
+// **********************************************************************
+//      Write 'current' to the older slot and flush it to disk
+// **********************************************************************
+static int journal_commit(struct journal *j)
+{
+  if (j->slots == NULL)
+    return 1;
+
+  j->current.magic = JOURNAL_MAGIC;
+  j->current.seq  += 1;
+  j->current.crc   = crc32(&j->current, offsetof(struct journal_record, crc));
+
+  memcpy(slot(j, j->current.seq % JOURNAL_SLOTS), &j->current, sizeof(j->current));
+  return msync(j->slots, j->size, MS_SYNC) == 0 ? 0 : 1;
+}
+
+// **********************************************************************
+//      Open (or create) the journal file and map it into memory
+// **********************************************************************
+int journal_open(struct journal *j, const char *filename)
+{
+  memset(&j->current, 0, sizeof(j->current));
+  j->slots = NULL;
+  j->size  = (size_t) JOURNAL_SLOTS * JOURNAL_PAGE;
+  j->fd    = open(filename, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (j->fd < 0)
+    return 1;
+
+  struct stat st;
+  if (fstat(j->fd, &st) != 0 || 
+      ((size_t) st.st_size < j->size && ftruncate(j->fd, j->size) != 0)) {
+    journal_close(j);
+    return 1;
+  }
+
+  void *p = mmap(NULL, j->size, PROT_READ | PROT_WRITE, MAP_SHARED, j->fd, 0);
+  if (p == MAP_FAILED) {
+    journal_close(j);
+    return 1;
+  }
+  j->slots = (uint8_t *) p;
+
+  // start from the newest valid record, if there is one
+  for (int i = 0; i < JOURNAL_SLOTS; i++) {
+    if (record_valid(slot(j, i)) && slot(j, i)->seq >= j->current.seq)
+      j->current = *slot(j, i);
+  }
+  return 0;
+}
+
+// **********************************************************************
+//      Return the newest valid record. Returns 1 if there is none.
+// **********************************************************************
+int journal_load(struct journal *j, struct journal_record *rec)
+{
+  if (j->slots == NULL || j->current.magic != JOURNAL_MAGIC)
+    return 1;
+  *rec = j->current;
+  return 0;
+}
+
+// **********************************************************************
+//      Record a new plan for the day
+// **********************************************************************
+int journal_set_plan(struct journal *j, int daynum, time_t t_ontime, time_t t_offtime)
+{
+  j->current.daynum    = daynum;
+  j->current.t_ontime  = t_ontime;
+  j->current.t_offtime = t_offtime;
+  return journal_commit(j);
+}
+
+// **********************************************************************
+//      Record the state a switch was last commanded to
+// **********************************************************************
+int journal_set_switch(struct journal *j, int i, bool on)
+{
+  if (on)
+    j->current.switches_on |=  (1u << i);
+  else
+    j->current.switches_on &= ~(1u << i);
+  return journal_commit(j);
+}
+
+// **********************************************************************
+//      Record the on/off state of the main loop
+// **********************************************************************
+int journal_set_lights(struct journal *j, bool on)
+{
+  j->current.lights_are_on = on;
+  return journal_commit(j);
+}
+
+void journal_close(struct journal *j)
+{
+  if (j->slots != NULL)
+    munmap(j->slots, j->size);
+  if (j->fd >= 0)
+    close(j->fd);
+  j->slots = NULL;
+  j->fd    = -1;
+}
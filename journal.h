@@ -0,0 +1,49 @@
+/* 
+	journal.h
+
+	Crash-safe state journal. The last commanded state of every switch and
+	the current on/off plan are kept in a small memory-mapped file, so that
+	a restarted daemon can pick up where it left off instead of sweeping
+	all lights off.
+*/
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdint.h>
+#include <time.h>
+
+#define JOURNAL_FILE  "/var/lib/lights433.journal"
+#define JOURNAL_DIR   "/var/lib/lights433"	// journals of the sites in the sites directory
+#define JOURNAL_MAGIC 0x4C343333	// "L433"
+#define JOURNAL_SLOTS 2			// records are written alternately to two slots
+#define JOURNAL_PAGE  4096		// bytes per slot: a torn write stays within its own flash page
+
+// One journal record. The slot with the highest sequence number and a
+// valid checksum is the current one.
+struct journal_record {
+  uint32_t magic;
+  uint32_t seq;           // sequence number, incremented on every update
+  int32_t  daynum;        // day number the plan was calculated for
+  uint32_t switches_on;   // bit i is set if switch i was last commanded on
+  int64_t  t_ontime;      // planned time to switch on
+  int64_t  t_offtime;     // planned time to switch off
+  uint32_t lights_are_on; // state of the main loop
+  uint32_t crc;           // CRC-32 over all preceding fields
+};
+
+// An open journal (one per site)
+struct journal {
+  uint8_t *slots;                 // memory-mapped journal file, one slot per JOURNAL_PAGE
+  struct journal_record  current; // copy of the newest record
+  int    fd;
+  size_t size;
+};
+
+int  journal_open(struct journal *, const char *);
+int  journal_load(struct journal *, struct journal_record *);
+int  journal_set_plan(struct journal *, int, time_t, time_t);
+int  journal_set_switch(struct journal *, int, bool);
+int  journal_set_lights(struct journal *, bool);
+void journal_close(struct journal *);
+
+#endif
@@ -36,172 +36,1279 @@ using std::chrono::system_clock;
 //     Global variables
 // **********************************************************************
 
-// Arrays to store switch on/off codes and whether they should be contolled
-int code_on  [7];
-int code_off [7];
-bool contolled_switches [7];
+// Every site (household) served by this process. Everything about a site
+// lives in its struct; transmitters, receiver, log and event loop are shared.
+std::vector<struct site *> sites;
 
-// Variables specific to current location (used in AstroCalc4R)
-double xlat;   // Latitude
-double xlon;   // Longitude
-int    tzone;  // Hours from GST (e.g. EST = -5)
+// Pin of the 433MHz receiver (-1 = no receiver)
+int RX_PIN;
 
-// Pin to use as output. GPIO0 is physical pin 11 on rev B 
-// Read about pins here: http://wiringpi.com/pins/
-int PIN;
+// The main configuration file and the directory of further sites
+static std::string config_file;
+static std::string sites_dir;
 
-// Variables to control lights on/off cycle
-int on_hour;    // Time to switch off; hour (24 hour format)
-int on_min;     //                     min  (24 hour format)
-int on_offset;  // offset ( in minutes) before/after on time
-int off_hour;   // Hour to switch off; hour (24 hour format)
-int off_min;    //                     min  (24 hour format)
-int off_ofset;  // Randomized offset (in minutes)
+// State directory of a simulation ('lights433 simulate <dir>'; empty: the
+// real daemon). See state_path().
+static std::string state_dir;
+
+// The configuration and plan of all sites for readers on other threads,
+// replaced as a whole (see rcu.h), and the number of SIGHUPs received
+rcu_ptr<struct plan_snapshot> current_plan;
+static std::atomic<unsigned int> reload_requests(0);
+
+// Health counters of the status block, and when the daemon started
+// (event loop only)
+static struct status_health health;
+static time_t started;
+
+// Write to the log file (off for the command line tools)
+bool logging = true;
+std::recursive_mutex log_lock;      // the transmitter threads log as well
 
 
 // **********************************************************************
 //    main
 // **********************************************************************
 int main(int argc, char *argv[]) {
- 
-  bool lights_are_on;       // flag to keep track of the status of the lights
-  int status;               // flag to determine whether the time is within a range
+
   char buffer [CHARSIZE];   // character buffer for output
+  char line [LOG_LINE];     // ... for messages with a file name
+
+  // lights433 simulate <dir> [command ...]: the daemon or a command with
+  // every transmitter simulated, no receiver and its state in <dir>
+  if (argc > 2 && strcmp(argv[1], "simulate") == 0) {
+    state_dir = argv[2];
+    mkdir(state_dir.c_str(), 0755);
+    log_configure(state_path(LOG_FILE), LOG_SEGMENT_SIZE, LOG_SEGMENTS, LOG_MAX_SIZE);
+    argv[2] = argv[0];
+    argc -= 2;
+    argv += 2;
+  }
+
+  // Command line tools
+  if (argc > 1 && strcmp(argv[1], "vacation") == 0) {
+    logging = false;
+    read_config(false);
+    return print_vacation_plan(argc > 2 ? atoi(argv[2]) : 7);
+  }
+  if (argc > 1 && strcmp(argv[1], "plan") == 0) {
+    logging = false;
+    read_config(false);
+    return export_plan(argc, argv);
+  }
+  if (argc > 1 && strcmp(argv[1], "airtime") == 0) {
+    logging = false;
+    read_config(false);
+    // channel of the first transmitter, or the defaults if there is none
+    struct rf_channel ch = { RF_FRAME_LOSS, RF_BURST };
+    double target = RF_DELIVERY;
+    if (transmitter_count() > 0) {
+      ch     = transmitter_get(0)->channel;
+      target = transmitter_get(0)->delivery;
+    }
+    return rf_model_report(&ch, target, argc > 2 ? std::max(1, atoi(argv[2])) : 6, 24, 
+                           argc > 3 ? std::max(1, atoi(argv[3])) : 100000);
+  }
+  if (argc > 1 && strcmp(argv[1], "sun") == 0) {
+    logging = false;
+    read_config(false);
+    if (sites.empty())
+      return 1;
+    // the given day (default today) of the first site, at its midnight
+    struct site *s = sites[0];
+    int32_t day = argc > 2 ? plan_parse_day(argv[2]) : epoch_day(s, time(NULL));
+    if (day == INT32_MIN) {
+      fprintf(stderr, "Usage: lights433 sun [YYYY-MM-DD [step]]\n");
+      return 1;
+    }
+    struct sun_tracker place;
+    sun_track_init(&place, s->xlat, s->xlon, s->tzone, SUN_STEP);
+    return sun_check(&place, (time_t) day * 86400 - 3600 * (time_t) s->tzone, argc > 3 ? std::max(1, atoi(argv[3])) : 60);
+  }
+  if (argc > 1 && strcmp(argv[1], "usage") == 0) {
+    logging = false;
+    read_config(false);
+    return print_usage(argc, argv);
+  }
+  if (argc > 1 && strcmp(argv[1], "diff") == 0) {
+    logging = false;
+    read_config(false);
+    return print_diff(argc, argv);
+  }
+  if (argc > 1 && strcmp(argv[1], "calendar") == 0) {
+    logging = false;
+    read_config(false);
+    return print_calendar(argc, argv);
+  }
+  if (argc > 1 && strcmp(argv[1], "rules") == 0) {
+    logging = false;
+    read_config(false);
+    return print_rules();
+  }
+  if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+    logging = false;
+    read_config(false);
+    return run_bench(argc, argv);
+  }
+  if (argc > 1 && strcmp(argv[1], "mathcheck") == 0) 
+    return fastmath_check(argc > 2 ? atof(argv[2]) : SOLAR_ERROR_BUDGET);
+  if (argc > 1 && strcmp(argv[1], "history") == 0) {
+    logging = false;
+    read_config(false);     // for the names of the sites
+    return print_history(argc, argv);
+  }
+  if (argc > 1 && strcmp(argv[1], "events") == 0) {
+    logging = false;
+    return print_events(argc, argv);
+  }
+  if (argc > 1 && strcmp(argv[1], "status") == 0) {
+    logging = false;
+    return print_status(argc, argv);
+  }
+  if (argc > 1 && strcmp(argv[1], "jitter") == 0) {
+    logging = false;
+    read_config(false);
+    wiringPiSetup ();
+    // on the first transmitter, or only timed if there is none
+    struct transmitter *tx = transmitter_count() > 0 ? transmitter_get(0) : NULL;
+    return jitter_test(tx && !tx->simulate ? tx->pin : -1, argc > 2 ? atoi(argv[2]) : 20, 
+                       sites.empty() ? 0 : sites[0]->code_off[0], tx ? tx->priority : RT_PRIORITY, tx ? tx->cpu : -1);
+  }
+  if (argc > 1 && (strcmp(argv[1], "learn") == 0 || strcmp(argv[1], "replay") == 0 ||
+                   strcmp(argv[1], "record") == 0)) {
+    logging = false;
+    read_config(false);
+    return receive_tool(argc, argv);
+  }
 
   // write to the log file that the program is starting 
   logthis("*******************************************");
   logthis("Starting program lights433 ....");
 
-  // Read the initialization file, named 
-  read_ini_file("/etc/lights433.conf");
-  logthis("- Reading the configuration file");
+  // Read the initialization file and the sites; plan today for all of
+  // them and open their journals (in parallel)
+  // Event stream for local subscribers; open before the sites are 
+  // planned, so that their plans are published as well
+  if (!state_dir.empty()) {
+    snprintf(line, LOG_LINE, "- Simulating, state in %s", state_dir.c_str());
+    logthis(line);
+  }
+  std::string bus_file    = state_path(EVENTBUS_FILE);
+  std::string bus_socket  = state_path(EVENTBUS_SOCKET);
+  std::string status_file = state_path(STATUS_FILE);
+  std::string history_dir = state_path(HISTORY_DIR);
+  if (eventbus_open(bus_file.c_str()) != 0) {
+    snprintf(line, LOG_LINE, "ERROR: Cannot create the event stream %s", bus_file.c_str());
+    logthis(line);
+  }
+  started = time(NULL);
+  if (status_open(status_file.c_str()) != 0) {
+    snprintf(line, LOG_LINE, "ERROR: Cannot create the status block %s", status_file.c_str());
+    logthis(line);
+  }
 
-  // Initialize wiringPi
-  wiringPiSetup ();
-  logthis("- Initializing the wiringPi library");
+  logthis("- Reading the configuration");
+  read_config(true);
+  if (sites.empty()) {
+    logthis("ERROR: No site configured");
+    return 1;
+  }
+  std::sprintf (buffer, "- Serving %d site(s)", (int) sites.size());
+  logthis(buffer);
+  publish_plan();
 
-  // Switch off the lights 
-  logthis("- Make sure that lights are off");
-  switch_lights(LIGHTS_OFF);
-  lights_are_on = false;
+  // Initialize wiringPi (a simulation leaves the pins alone)
+  if (state_dir.empty()) {
+    wiringPiSetup ();
+    logthis("- Initializing the wiringPi library");
+  }
+
+  // One queue and worker thread per transmitter, shared by all sites
+  transmitter_start();
+  std::sprintf (buffer, "- Starting %d transmitter(s)", transmitter_count());
+  logthis(buffer);
+
+  // Event history
+  if (history_open(history_dir.c_str(), true) != 0) {
+    snprintf(line, LOG_LINE, "ERROR: Cannot open the event history in %s", history_dir.c_str());
+    logthis(line);
+  }
+  eventbus_greeting(plan_greeting);
+  if (eventbus_serve(bus_socket.c_str()) == 0)
+    snprintf(line, LOG_LINE, "- Publishing events on %s and %s", bus_file.c_str(), bus_socket.c_str());
+  else
+    snprintf(line, LOG_LINE, "ERROR: Cannot serve events on %s", bus_socket.c_str());
+  logthis(line);
+
+  // Mirror presses on the remote into our state
+  if (RX_PIN >= 0) {
+    code_index_sites();
+    if (receiver_start(RX_PIN, [](const struct rx_code &c) {
+          loop_post([c] { received_code(c); });
+        }) == 0)
+      logthis("- Listening for 433MHz codes");
+    else
+      logthis("ERROR: Cannot set up the interrupt of the receiver pin");
+  }
+
+  // Read the site files again on SIGHUP (the control loops pick it up)
+  signal(SIGHUP, [](int) { reload_requests++; });
+
+  // Start a control loop per site and run the event loop (never returns)
+  std::vector<task> loops;
+  for (struct site *s : sites) {
+    loops.push_back(control_loop(s));
+    if (s->facade_mask != 0)
+      s->facade = facade_loop(s);
+  }
+  update_status();
+  loop_run();
+  return 0;
+} /* ***** end of main() ****** */
+
+
+// **********************************************************************
+//    Control loop of a site: switch lights on/off according to the plan 
+//    for the day. All sites run their loop on the one event loop.
+// **********************************************************************
+task control_loop(struct site *s)
+{
+  bool lights_are_on;       // flag to keep track of the status of the lights
+  unsigned int desired;     // switches that should be on according to the plan
 
-  int daynum       = daynumber( time(NULL) );   // The current day number of the year
-  time_t t_sunset  = calc_sunriseset(SUNSET);   // Calculate time of sunset
-  time_t t_ontime  = calc_ontime(t_sunset);     // Calculate time to switch on the lights
-  time_t t_offtime = calc_offtime(t_sunset);    // Calculate time to switch off the lights 
+  // Restore the last known state from the journal (see prepare_site()). 
+  // If it is usable, only the switches that differ from the current plan 
+  // are sent; otherwise fall back to switching all lights off.
+  if (s->restored) {
+    site_log(s, "- Restoring state from the journal");
+  } else {
+    // Switch off the lights 
+    site_log(s, "- Make sure that lights are off");
+    co_await switch_lights(s, LIGHTS_OFF, HIST_SWEEP);
+  }
+  lights_are_on = planned_state(s) != 0;
+  journal_set_lights(&s->journal, lights_are_on);
+  unsigned int last_desired = planned_state(s);
+  int cause = HIST_RESTORE;     // the first round reconciles with the journal
   
   // Enter an infinate loop
   while( 1 )
   { 
-    // if it is past midnight AND the lights are off, then recalculate 
-    if ((daynumber( time(NULL) ) != daynum) && lights_are_on == false) 
-    {
-      daynum    = daynumber( time(NULL) );
-      t_sunset  = calc_sunriseset(SUNSET);
-      t_ontime  = calc_ontime(t_sunset);  
-      t_offtime = calc_offtime(t_sunset); 
+    // new settings from the site file, for the day already planned
+    if (s->reloads != reload_requests.load()) {
+      s->reloads = reload_requests.load();
+      reload_site(s);
+    }
+
+    // past midnight: take the new day from the horizon (the lights of
+    // last night stay on until their off time), and extend the horizon
+    // in the background before it runs out
+    if (epoch_day(s, time(NULL)) != s->daynum) {
+      plan_day(s, time(NULL));
+      publish_plan();
     }
+    extend_horizon(s);
+
+    desired = planned_state(s);
 
-    status = time_in_range(t_ontime, t_offtime);
+    // a switch set by hand on the remote keeps its state until its next
+    // planned transition
+    s->override_mask &= ~(desired ^ last_desired);
+    last_desired = desired;
+    desired = (desired & ~s->override_mask) | (s->switch_state & s->override_mask);
       #ifdef VERBOSE
-      cout << "On time: "  << std::asctime(std::localtime(&t_ontime)) << \
-              "Off time: " << std::asctime(std::localtime(&t_offtime)) << \
-              currentDateTime() << ": Status: " << status << \
-              "  On: " << lights_are_on << endl; 
+      printf("%s: On time: %sOff time: %s%s: Planned: %u  On: %u\n", s->name.c_str(), 
+             std::asctime(std::localtime(&s->t_ontime)), std::asctime(std::localtime(&s->t_offtime)), 
+             currentDateTime().c_str(), desired, s->switch_state);
       #endif
-    switch (status) {
-      // ************ time is within the range *****************
-      case 1:   
-        // if the lights are off, then switch them on 
-        if (lights_are_on == false) {
-          logthis("Switching on the lights ");
-          switch_lights(LIGHTS_ON);
-          lights_are_on = true;
-        }
-        // however, if the lights are on, then proceed
-        break;
-      
-      // ************ time is outside of the range **************
-      case 0:
-        // if the lights are on, then switch them off
-        if (lights_are_on == true) {
-          logthis("Switching off the lights ");
-          switch_lights(LIGHTS_OFF);
-          lights_are_on = false;
-        }
-        // however, if lights are off, then proceed
-        break;
-    }  // end of switch (status)
+    if (desired & ~s->switch_state & controlled_mask(s))
+      site_log(s, "Switching on the lights ");
+    if (~desired & s->switch_state & controlled_mask(s))
+      site_log(s, "Switching off the lights ");
+    if (lights_are_on != (desired != 0)) {
+      lights_are_on = desired != 0;
+      journal_set_lights(&s->journal, lights_are_on);
+    }
+    // send only the switches that differ from the plan
+    co_await reconcile_lights(s, desired, cause);
+    cause = HIST_PLAN;
+    health.cycles++;
+    update_status();
+
+    // free the snapshots no reader uses any more
+    rcu_reclaim();
+
     // wait a bit before repeaing the infinate loop
-    std::this_thread::sleep_for(std::chrono::milliseconds(CYCLE));
+    co_await delay(CYCLE);
   } // end of infinate loop 
+}
+
+// **********************************************************************
+//    Follow the sun for the facade rules of a site, every SUN_STEP
+//    seconds. When the sun leaves a facade in the afternoon its switch
+//    goes on (it is part of planned_state() until its planned on time).
+//    At start the tracker runs from midnight, to know which facades the
+//    sun has already shone on and left. The task is kept in the site; a
+//    reload cancels it and, if the site still has facade rules, starts
+//    a new one (the location may have changed).
+// **********************************************************************
+task facade_loop(struct site *s)
+{
+  char buffer [CHARSIZE];
+  struct sun_tracker tr;
+  time_t now = time(NULL);
+  bool catching_up = true;
+
+  sun_track_init(&tr, s->xlat, s->xlon, s->tzone, SUN_STEP);
+  sun_track_seek(&tr, (time_t) epoch_day(s, now) * 86400 - 3600 * (time_t) s->tzone);
+  while (!co_await cancelled()) {
+    now = time(NULL);
+    unsigned int newly_dark = 0;
+    while (tr.t + tr.step <= now) {
+      sun_track_step(&tr);
+      newly_dark |= facade_update(s, &tr);
+    }
+    for (int i = 0; i < 7 && !catching_up; i++) {
+      unsigned int bit = 1u << i;
+      if (!(newly_dark & bit))
+        continue;
+      std::sprintf (buffer, "The sun has left the facade of switch_%02d", i + 1);
+      site_log(s, buffer);
+      if ((planned_state(s) & bit) && !(s->switch_state & bit) && !(s->override_mask & bit) &&
+          !co_await cancelled())
+        co_await switch_one(s, i, LIGHTS_ON, HIST_PLAN);
+    }
+    catching_up = false;
+    co_await delay(1000 * SUN_STEP);
+  }
+}
+
+// **********************************************************************
+//    The facades at the tracker's position: returns the switches whose
+//    facade the sun has just left
+// **********************************************************************
+unsigned int facade_update(struct site *s, const struct sun_tracker *tr)
+{
+  if (tr->day != s->facade_day) {
+    s->facade_day  = tr->day;
+    s->facade_lit  = 0;
+    s->facade_dark = 0;
+  }
+  if (!sun_track_afternoon(tr))
+    return 0;
+
+  struct sun_vector v = sun_track_vector(tr);
+  unsigned int now_dark = 0;
+  for (int i = 0; i < 7; i++) {
+    unsigned int bit = 1u << i;
+    if (!(s->facade_mask & bit))
+      continue;
+    if (facade_lit(&s->walls[i], &v)) {
+      s->facade_lit |= bit;
+    } else if ((s->facade_lit & bit) && !(s->facade_dark & bit)) {
+      s->facade_dark |= bit;
+      now_dark |= bit;
+    }
+  }
+  return now_dark;
+}
+
+// The nights of the day before 'day': today's if that is the day
+// before, else the horizon's
+static void night_before(struct site *s, const struct plan_horizon *h, int32_t day)
+{
+  const struct plan_day *before = horizon_day(h, day - 1);
+  for (int i = 0; i < 7; i++) {
+    if (day == s->daynum + 1)
+      s->last_night[i] = s->night[i];
+    else if (before != NULL && (before->switches & (1u << i)))
+      s->last_night[i] = before->night[i];
+    else
+      s->last_night[i].n = 0;
+  }
+}
+
+// **********************************************************************
+//    Make the day of 'when' today's plan of a site and record it in its
+//    journal. The day is looked up in the horizon; only if it is not
+//    there (yet) the horizon is planned first. The nights of the day
+//    before are kept, as their off times may be after midnight.
+// **********************************************************************
+void plan_day(struct site *s, time_t when)
+{
+  char buffer [CHARSIZE];
+  int32_t day = epoch_day(s, when);
+  struct rcu_reader reader;
+  if (horizon_day(s->horizon.load(), day) == NULL)
+    plan_horizon(s, day);
+  const struct plan_horizon *h = s->horizon.load();
+  const struct plan_day *pd = horizon_day(h, day);
+
+  night_before(s, h, day);
+  s->daynum    = day;
+  s->t_ontime  = pd->on;
+  s->t_offtime = pd->off;
+  for (int i = 0; i < 7; i++) {
+    if (pd->switches & (1u << i))
+      s->night[i] = pd->night[i];
+    else
+      s->night[i].n = 0;
+  }
+  std::strftime(buffer, CHARSIZE, "The time to switch on is:  %d-%m-%Y %H:%M:%S%p", std::localtime(&s->t_ontime));
+  site_log(s, buffer);
+  std::strftime(buffer, CHARSIZE, "The time to switch off is: %d-%m-%Y %H:%M:%S%p", std::localtime(&s->t_offtime));
+  site_log(s, buffer);
+  journal_set_plan(&s->journal, s->daynum, s->t_ontime, s->t_offtime);
+  publish_nights(s);
+}
+
+// **********************************************************************
+//    Plan the days from the day before 'day' to HORIZON_DAYS after it
+//    and swap them in at once
+// **********************************************************************
+void plan_horizon(struct site *s, int32_t day)
+{
+  struct horizon_job *job = site_job(s, day - 1, day + HORIZON_DAYS);
+  s->horizon.publish(horizon_run(job));
+  delete job;
+}
+
+// **********************************************************************
+//    Extend the horizon of a site on the planner thread when fewer than
+//    HORIZON_REFILL days are left. The event loop swaps the new one in,
+//    unless the site was reloaded meanwhile (and planned again).
+// **********************************************************************
+void extend_horizon(struct site *s)
+{
+  int32_t today = epoch_day(s, time(NULL));
+  {
+    struct rcu_reader reader;
+    const struct plan_horizon *h = s->horizon.load();
+    if ((h != NULL && h->last - today >= HORIZON_REFILL) || s->horizon_asked == today)
+      return;
+  }
+  s->horizon_asked = today;
+  unsigned int reloads = s->reloads;
+  horizon_request(site_job(s, today - 1, today + HORIZON_DAYS), [s, reloads](struct plan_horizon *h) {
+    loop_post([s, reloads, h] {
+      if (s->reloads != reloads) {
+        delete h;
+        return;
+      }
+      char buffer [CHARSIZE];
+      struct civil_date c = civil_from_days(h->last);
+      std::sprintf(buffer, "- Planned ahead until %04d-%02d-%02d", c.year, c.month, c.day);
+      site_log(s, buffer);
+      s->horizon.publish(h);
+    });
+  });
+}
+
+// **********************************************************************
+//    Publish the configuration and plan of all sites as a new snapshot
+//    (on the event loop, or before it runs). Readers on other threads
+//    keep the one they loaded until their read section ends.
+// **********************************************************************
+void publish_plan(void)
+{
+  static uint64_t generation = 0;
+  struct plan_snapshot *p = new struct plan_snapshot;
+  p->generation = ++generation;
+  p->published  = time(NULL);
+  p->sites.resize(sites.size());
+  for (size_t k = 0; k < sites.size(); k++) {
+    const struct site *s = sites[k];
+    struct site_snapshot *v = &p->sites[k];
+    v->name       = s->name;
+    v->index      = s->index;
+    v->id         = s->id;
+    v->controlled = controlled_mask(s);
+    v->lat        = s->xlat;
+    v->lon        = s->xlon;
+    v->tzone      = s->tzone;
+    v->daynum     = s->daynum;
+    v->t_ontime   = s->t_ontime;
+    v->t_offtime  = s->t_offtime;
+    for (int i = 0; i < 7; i++) {
+      v->code_on [i] = s->code_on [i];
+      v->code_off[i] = s->code_off[i];
+      v->tx_mask [i] = s->tx_mask [i];
+      v->night   [i] = s->night   [i];
+    }
+  }
+  current_plan.publish(p);
+  rcu_reclaim();
+}
+
+// **********************************************************************
+//    The current plan as event lines (sequence number 0), for a new
+//    client of the event socket. Runs on the socket thread.
+// **********************************************************************
+std::string plan_greeting(void)
+{
+  std::string text;
+  char line [EVENTBUS_LINE];
+  struct bus_event ev {};
+  ev.seq.store(1, std::memory_order_relaxed);
+  ev.kind = BUS_PLANNED;
+
+  struct rcu_reader reader;
+  const struct plan_snapshot *p = current_plan.load();
+  if (p == NULL)
+    return text;
+  ev.rec.time  = p->published;
+  ev.rec.cause = HIST_PLAN;
+  for (const struct site_snapshot &v : p->sites) {
+    ev.rec.site = v.id;
+    for (int i = 0; i < 7; i++) {
+      if (!(v.controlled & (1u << i)))
+        continue;
+      ev.rec.sw           = i;
+      ev.rec.transmitters = v.tx_mask[i];
+      for (int k = 0; k < v.night[i].n; k++) {
+        ev.rec.action  = LIGHTS_ON;
+        ev.rec.planned = v.night[i].on[k];
+        text.append(line, eventbus_format(&ev, line, sizeof(line)));
+        ev.rec.action  = LIGHTS_OFF;
+        ev.rec.planned = v.night[i].off[k];
+        text.append(line, eventbus_format(&ev, line, sizeof(line)));
+      }
+    }
+  }
+  return text;
+}
+
+// **********************************************************************
+//    Read the file of a site again (after a SIGHUP): switches, location,
+//    cycle, vacation and day rules change, the state of the switches
+//    stays. The day already planned is planned again with the new
+//    settings. Returns 0, or 1 if the file cannot be read (the site
+//    keeps its old settings).
+// **********************************************************************
+int reload_site(struct site *s)
+{
+  struct site *n = new struct site();
+  n->file  = s->file;
+  n->index = s->index;
+  INIReader reader(s->file);
+  if (reader.ParseError() < 0 || read_site(reader, n) != 0) {
+    site_log(s, "ERROR: Cannot read the configuration again, keeping the old one");
+    delete n;
+    return 1;
+  }
+
+  s->name = n->name;
+  s->id   = n->id;
+  for (int i = 0; i < 7; i++) {
+    s->code_on[i]            = n->code_on[i];
+    s->code_off[i]           = n->code_off[i];
+    s->contolled_switches[i] = n->contolled_switches[i];
+    s->stagger[i]            = n->stagger[i];
+    s->tx_mask[i]            = n->tx_mask[i];
+    s->repeats[i]            = n->repeats[i];
+    s->watts[i]              = n->watts[i];
+    s->days_rule[i]          = n->days_rule[i];
+    s->facade_azimuth[i]     = n->facade_azimuth[i];
+    s->facade_horizon[i]     = n->facade_horizon[i];
+    s->walls[i]              = n->walls[i];
+  }
+  s->xlat          = n->xlat;
+  s->xlon          = n->xlon;
+  s->tzone         = n->tzone;
+  s->on_offset     = n->on_offset;
+  s->off_hour      = n->off_hour;
+  s->off_min       = n->off_min;
+  s->off_ofset     = n->off_ofset;
+  s->vacation_mode = n->vacation_mode;
+  s->vacation      = n->vacation;
+  s->calendar      = std::move(n->calendar);
+  s->vacation_days = n->vacation_days;
+  for (int i = 0; i < 7; i++) {
+    s->on_rule[i]  = std::move(n->on_rule[i]);
+    s->off_rule[i] = std::move(n->off_rule[i]);
+  }
+  s->facade_mask   = n->facade_mask;
+  delete n;
+  site_log(s, "- Configuration reloaded");
+  health.reloads++;
+
+  plan_horizon(s, s->daynum);
+  plan_day(s, (time_t) s->daynum * 86400 - 3600 * (time_t) s->tzone + 12 * 3600);
+  if (RX_PIN >= 0)
+    code_index_sites();
+  s->facade.cancel();
+  if (s->facade_mask != 0)
+    s->facade = facade_loop(s);
+  publish_plan();
   return 0;
-} /* ***** end of main() ****** */
+}
+
+// **********************************************************************
+//    Log a message of a site; with more than one site it is tagged with
+//    the site name
+// **********************************************************************
+void site_log(const struct site *s, const char *messg)
+{
+  if (sites.size() <= 1) {
+    logthis(messg);
+    return;
+  }
+  char buffer [LOG_LINE];
+  snprintf(buffer, sizeof(buffer), "[%s] %s", s->name.c_str(), messg);
+  logthis(buffer);
+}
 
+// **********************************************************************
+//    Open the journal of a site and plan today. If the journal has a 
+//    plan for today it is kept, including the randomized off time.
+// **********************************************************************
+static void prepare_site(struct site *s)
+{
+  struct journal_record rec;
+  std::string file = state_path(JOURNAL_FILE);
+  time_t now = time(NULL);
+
+  // the site of the main configuration file keeps the original journal
+  if (s->file != config_file) {
+    std::string base = s->file.substr(s->file.rfind('/') + 1);
+    std::string dir = state_path(JOURNAL_DIR);
+    mkdir(dir.c_str(), 0755);
+    file = dir + "/" + base.substr(0, base.rfind('.')) + ".journal";
+  }
+  s->restored = journal_open(&s->journal, file.c_str()) == 0 && journal_load(&s->journal, &rec) == 0;
+  if (s->restored && rec.daynum == epoch_day(s, now)) {
+    plan_horizon(s, rec.daynum);
+    struct rcu_reader reader;
+    night_before(s, s->horizon.load(), rec.daynum);
+    s->daynum    = rec.daynum;
+    s->t_ontime  = rec.t_ontime;
+    s->t_offtime = rec.t_offtime;
+    plan_nights(s, s->t_ontime, s->t_offtime);
+  } else {
+    plan_day(s, now);
+  }
+  if (s->restored)
+    s->switch_state = rec.switches_on;
+}
+
+// **********************************************************************
+//    Index the codes of all sites for the receiver. Entry 7 * k + i is 
+//    switch i of site k.
+// **********************************************************************
+void code_index_sites(void)
+{
+  std::vector<int> on (7 * sites.size()), off (7 * sites.size());
+  for (size_t k = 0; k < sites.size(); k++) {
+    for (int i = 0; i < 7; i++) {
+      on [7 * k + i] = sites[k]->code_on [i];
+      off[7 * k + i] = sites[k]->code_off[i];
+    }
+  }
+  code_index_build(on.data(), off.data(), (int) on.size());
+}
 
 // **********************************************************************
-//      Minimalist logging system
+//    A code was received (runs on the event loop). If it belongs to one of
+//    our switches, mirror it into the switch state.
 // **********************************************************************
-int logthis(std::string messg)
+void received_code(const struct rx_code &c)
 {
   char buffer [CHARSIZE];     // character buffer for output
+  int  sw;
+  bool on;
 
-  std::string logfile = "/var/log/lights433.log";
-  std::string logmessg = currentDateTime();
-  logmessg = logmessg + ": " + messg; 
-
-  std::ofstream myfile;
-  myfile.exceptions ( std::ifstream::failbit | std::ifstream::badbit );
-  try {
-    myfile.open (logfile, std::ofstream::out | std::ofstream::app);
-    if (myfile.is_open())  {
-        myfile << logmessg << endl;
-        myfile.close();
-    }
-    // log all messages also to screen if VERBOSE is set
-    #ifdef VERBOSE
-    std::cout << logmessg << endl;
-    #endif
-  }
-  catch (std::ifstream::failure e) {
-    strcpy (buffer, "ERROR: Exception opening/reading/closing the log file.");
-    logthis(buffer);
-    std::cerr << "Exception opening/reading/closing the log file\n";
+  // our own transmissions are heard by the receiver as well
+  if (!code_index_find(c.code, &sw, &on) || transmit_in_flight(c.code))
+    return;
+  struct site *s = sites[sw / 7];
+  sw %= 7;
+  std::sprintf (buffer, "   Received code: %lu (switch %d %s)", c.code, sw + 1, on ? "on" : "off");
+  site_log(s, buffer);
+
+  // the ALL code switches every outlet
+  for (int i = 0; i < 7; i++) {
+    if ((i == sw || sw == 6) && ((s->switch_state >> i) & 1) != on) {
+      set_switch_state(s, i, on);
+      s->override_mask |= (1u << i);
+      record_event(s, i, on ? LIGHTS_ON : LIGHTS_OFF, HIST_REMOTE, 0);
+    }
+  }
+  health.codes_received++;
+  update_status();
+}
+
+// **********************************************************************
+//    Command line tools of the receiver:
+//      learn                    print every code received
+//      replay <file>            decode a recorded edge trace
+//      record <file> [seconds]  record edges into a trace file
+// **********************************************************************
+int receive_tool(int argc, char *argv[])
+{
+  auto print_code = [](const struct rx_code &c) {
+    int  sw;
+    bool on;
+    std::printf("code %lu  bits %d  protocol %d", c.code, c.bits, c.protocol);
+    if (code_index_find(c.code, &sw, &on) && sites.size() > 1)
+      std::printf("  (%s switch %d %s)", sites[sw / 7]->name.c_str(), sw % 7 + 1, on ? "on" : "off");
+    else if (code_index_find(c.code, &sw, &on))
+      std::printf("  (switch %d %s)", sw + 1, on ? "on" : "off");
+    std::printf("\n");
+    std::fflush(stdout);
+  };
+  code_index_sites();
+
+  if (strcmp(argv[1], "replay") == 0) {
+    if (argc < 3 || receiver_replay(argv[2], print_code) != 0) {
+      fprintf(stderr, "Usage: lights433 replay <trace file>\n");
+      return 1;
+    }
+    return 0;
+  }
+
+  if (RX_PIN < 0) {
+    fprintf(stderr, "No receiver pin configured ([receiver] pin)\n");
     return 1;
   }
-  return 0; 
+  wiringPiSetup ();
+  if (strcmp(argv[1], "record") == 0) {
+    if (argc < 3 || receiver_record(RX_PIN, argv[2], argc > 3 ? atoi(argv[3]) : 10) != 0) {
+      fprintf(stderr, "Usage: lights433 record <trace file> [seconds]\n");
+      return 1;
+    }
+    return 0;
+  }
+  if (receiver_start(RX_PIN, print_code) != 0) {
+    fprintf(stderr, "Cannot set up the interrupt of pin %d\n", RX_PIN);
+    return 1;
+  }
+  while (1)
+    std::this_thread::sleep_for(std::chrono::seconds(1));
 }
 
+// **********************************************************************
+//    Plan tonight's on-intervals of every controlled switch. In vacation
+//    mode each switch gets its own randomized sequence; otherwise all
+//    switches follow the same on/off times. A switch whose day rule does
+//    not hold tonight stays off.
+// **********************************************************************
+void plan_nights(struct site *s, time_t t_ontime, time_t t_offtime)
+{
+  int32_t day = epoch_day(s, t_ontime);
+  bool vacation = s->vacation_mode || (s->vacation_days >= 0 && daycal_test(&s->calendar, s->vacation_days, day));
+  for (int i = 0; i < 7; i++) {
+    if (!rule_empty(&s->on_rule[i]) || !rule_empty(&s->off_rule[i])) {
+      // the times of its rules, as planned for the day
+      struct rcu_reader reader;
+      const struct plan_day *pd = horizon_day(s->horizon.load(), day);
+      if (pd != NULL && (pd->switches & (1u << i)))
+        s->night[i] = pd->night[i];
+      else
+        s->night[i].n = 0;
+    } else if (!daycal_test(&s->calendar, s->days_rule[i], day)) {
+      s->night[i].n = 0;
+    } else if (vacation) {
+      vacation_night(s->id, i, day, t_ontime, t_offtime, &s->vacation, &s->night[i]);
+    } else {
+      s->night[i].n      = 1;
+      s->night[i].on [0] = t_ontime;
+      s->night[i].off[0] = t_offtime;
+    }
+  }
+
+  publish_nights(s);
+}
 
 // **********************************************************************
-//      Function to determine if the current time is within a given range
+//    Tell the subscribers of the event stream about today's plan
 // **********************************************************************
-int time_in_range(time_t a, time_t b)
+void publish_nights(const struct site *s)
 {
-  std::time_t tnow = std::time(NULL); 
+  struct history_record rec;
+  memset(&rec, 0, sizeof(rec));
+  rec.time  = time(NULL);
+  rec.site  = s->id;
+  rec.cause = HIST_PLAN;
+  for (int i = 0; i < 7; i++) {
+    if (!s->contolled_switches[i])
+      continue;
+    rec.sw           = i;
+    rec.transmitters = s->tx_mask[i];
+    for (int k = 0; k < s->night[i].n; k++) {
+      rec.action  = LIGHTS_ON;
+      rec.planned = s->night[i].on[k];
+      eventbus_publish(BUS_PLANNED, &rec);
+      rec.action  = LIGHTS_OFF;
+      rec.planned = s->night[i].off[k];
+      eventbus_publish(BUS_PLANNED, &rec);
+    }
+  }
+}
 
-  if ( (difftime(tnow, a) > 0) && (difftime(b, tnow) > 0) )
+// **********************************************************************
+//    Switches that should be on now according to the plan
+// **********************************************************************
+unsigned int planned_state(const struct site *s)
+{
+  unsigned int mask = 0;
+  for (int i = 0; i < 7; i++) {
+    if (!s->contolled_switches[i])
+      continue;
+    for (int k = 0; k < s->night[i].n; k++) {
+      if (time_in_range(s->night[i].on[k], s->night[i].off[k]))
+        mask |= (1u << i);
+    }
+    // last night, until its off time (after midnight)
+    for (int k = 0; k < s->last_night[i].n; k++) {
+      if (time_in_range(s->last_night[i].on[k], s->last_night[i].off[k]))
+        mask |= (1u << i);
+    }
+    // the sun has left its facade today, and it is not yet its on time
+    if ((s->facade_dark & (1u << i)) && s->facade_day == epoch_day(s, time(NULL)) && s->night[i].n > 0 &&
+        time(NULL) < s->night[i].on[0])
+      mask |= (1u << i);
+  }
+  return mask;
+}
+
+// **********************************************************************
+//    Bit mask of the controlled switches
+// **********************************************************************
+unsigned int controlled_mask(const struct site *s)
+{
+  unsigned int mask = 0;
+  for (int i = 0; i < 7; i++) {
+    if (s->contolled_switches[i])
+      mask |= (1u << i);
+  }
+  return mask;
+}
+
+// **********************************************************************
+//    Day number since the epoch in local standard time. Together with
+//    the site and switch it identifies the random numbers of a night.
+// **********************************************************************
+int32_t epoch_day(const struct site *s, time_t t)
+{
+  return day_of_time(t, s->tzone);
+}
+
+// **********************************************************************
+//    Print the vacation plan of every site for the next 'nights' nights
+//    (for audit)
+// **********************************************************************
+int print_vacation_plan(int nights)
+{
+  char from [CHARSIZE], to [CHARSIZE];
+
+  for (struct site *s : sites) {
+    if (sites.size() > 1)
+      std::printf("%s\n", s->name.c_str());
+
+    // the plan of the nights as if vacation mode were on (with the time
+    // rules of the switches)
+    struct plan_site ps;
+    int32_t first = epoch_day(s, time(NULL));
+    site_plan(s, first, first + nights - 1, &ps);
+    ps.vacation = true;
+    plan_days(&ps, first, first + nights - 1, [&](const struct plan_day *days, int n) {
+      for (int d = 0; d < n; d++) {
+        for (int i = 0; i < 7; i++) {
+          if (!(days[d].switches & (1u << i)))
+            continue;
+          const struct switch_night *night = &days[d].night[i];
+          for (int k = 0; k < night->n; k++) {
+            std::strftime(from, CHARSIZE, "%Y-%m-%d %H:%M:%S", std::localtime(&night->on [k]));
+            std::strftime(to,   CHARSIZE, "%Y-%m-%d %H:%M:%S", std::localtime(&night->off[k]));
+            std::printf("switch_%02d  %s  %s\n", i + 1, from, to);
+          }
+        }
+      }
+    });
+  }
+  return 0;
+}
+
+// **********************************************************************
+//    Print the days of the day rules of every site in a year (default
+//    this year)
+// **********************************************************************
+int print_calendar(int argc, char *argv[])
+{
+  int32_t day = argc > 2 ? plan_parse_day(argv[2]) : INT32_MIN;
+  if (argc > 2 && day == INT32_MIN) {
+    fprintf(stderr, "Usage: lights433 calendar [YYYY-MM-DD]\n");
     return 1;
-  else 
-    return 0;
+  }
+  for (struct site *s : sites) {
+    if (sites.size() > 1)
+      std::printf("%s\n", s->name.c_str());
+    daycal_report(stdout, &s->calendar, day != INT32_MIN ? day : epoch_day(s, time(NULL)));
+  }
+  return 0;
 }
 
 // **********************************************************************
-//      Function to calculate the day number of the year
+//    Print the time rules of every site and the programs they compile to
 // **********************************************************************
-int daynumber(time_t timestamp) 
+int print_rules(void)
 {
-  struct tm *tml = localtime(&timestamp);
-  int dayOfMonth = tml->tm_mday;
-  int month      = tml->tm_mon+1;
-  int year       = tml->tm_year+1900;
+  for (struct site *s : sites) {
+    if (sites.size() > 1)
+      std::printf("%s\n", s->name.c_str());
+    for (int i = 0; i < 7; i++) {
+      const struct time_rule *rules[2] = { &s->on_rule[i], &s->off_rule[i] };
+      for (int j = 0; j < 2; j++) {
+        if (rule_empty(rules[j]))
+          continue;
+        std::printf("switch_%02d  %s  %s\n", i + 1, j == 0 ? "on " : "off", rules[j]->text.c_str());
+        std::printf("%s", rule_listing(rules[j]).c_str());
+      }
+    }
+  }
+  return 0;
+}
 
-  int currentDay = dayOfMonth + ((month < 3) ?
-  (int)((306 * month - 301) / 10) :
-  (int)((306 * month - 913) / 10) + ((year % 4 == 0 && (year % 100 != 0 || year % 400 == 0)) ? 60 : 59));
-  return currentDay;
+// **********************************************************************
+//    Export the schedule of all sites over a range of dates (YYYY-MM-DD,
+//    both included) to stdout, as CSV or binary columns
+// **********************************************************************
+int export_plan(int argc, char *argv[])
+{
+  int32_t first = argc > 2 ? plan_parse_day(argv[2]) : INT32_MIN;
+  int32_t last  = argc > 3 ? plan_parse_day(argv[3]) : INT32_MIN;
+  int format    = argc > 4 && strcmp(argv[4], "bin") == 0 ? PLAN_BINARY : PLAN_CSV;
+  if (first == INT32_MIN || last == INT32_MIN || last < first ||
+      (argc > 4 && format == PLAN_CSV && strcmp(argv[4], "csv") != 0)) {
+    fprintf(stderr, "Usage: lights433 plan <from YYYY-MM-DD> <to YYYY-MM-DD> [csv|bin]\n");
+    return 1;
+  }
+
+  std::vector<struct plan_site> ps (sites.size());
+  for (size_t k = 0; k < sites.size(); k++)
+    site_plan(sites[k], first, last, &ps[k]);
+
+  if (plan_export(stdout, ps.data(), (int) ps.size(), first, last, format) < 0) {
+    fprintf(stderr, "Cannot write the plan\n");
+    return 1;
+  }
+  return 0;
 }
 
+// what the schedule of a site depends on
+static void plan_fields(const struct site *s, struct plan_site *ps)
+{
+  ps->name       = s->name.c_str();
+  ps->id         = s->id;
+  ps->lat        = s->xlat;
+  ps->lon        = s->xlon;
+  ps->tzone      = s->tzone;
+  ps->on_offset  = s->on_offset;
+  ps->off_hour   = s->off_hour;
+  ps->off_min    = s->off_min;
+  ps->off_random = s->off_ofset;
+  ps->switches   = controlled_mask(s);
+  ps->vacation   = s->vacation_mode;
+  ps->vp         = s->vacation;
+  ps->calendar   = &s->calendar;
+  ps->vacation_days = s->vacation_days;
+  for (int i = 0; i < 7; i++) {
+    ps->days[i]     = s->days_rule[i];
+    ps->on_rule[i]  = s->on_rule[i];
+    ps->off_rule[i] = s->off_rule[i];
+  }
+}
+
+// **********************************************************************
+//    What the schedule of a site depends on, for days [first, last]
+//    (its day rules are compiled for them)
+// **********************************************************************
+void site_plan(struct site *s, int32_t first, int32_t last, struct plan_site *ps)
+{
+  plan_fields(s, ps);
+  // one bit per day of the whole range
+  if (!s->calendar.rules.empty())
+    daycal_compile(&s->calendar, first, last);
+}
+
+// **********************************************************************
+//    A copy of what the plan of days [first, last] of a site depends on,
+//    to plan them on another thread (see horizon.h)
+// **********************************************************************
+struct horizon_job *site_job(const struct site *s, int32_t first, int32_t last)
+{
+  struct horizon_job *job = new struct horizon_job;
+  job->name     = s->name;
+  job->calendar = s->calendar;
+  job->first    = first;
+  job->last     = last;
+  plan_fields(s, &job->site);
+  job->site.name     = job->name.c_str();
+  job->site.calendar = &job->calendar;
+  return job;
+}
+
+// days [first, last] from the arguments, default this year
+static int usage_range(int argc, char *argv[], int arg, int32_t *first, int32_t *last)
+{
+  struct civil_date today = civil_from_days(day_of_time(time(NULL), sites.empty() ? 0 : sites[0]->tzone));
+  *first = argc > arg     ? plan_parse_day(argv[arg])     : days_from_civil(today.year, 1, 1);
+  *last  = argc > arg + 1 ? plan_parse_day(argv[arg + 1]) : days_from_civil(civil_from_days(*first).year, 12, 31);
+  return *first == INT32_MIN || *last == INT32_MIN || *last < *first ? 1 : 0;
+}
+
+// **********************************************************************
+//    Hours on of every switch per month, the energy used and the hours
+//    switches are on together, from the per-minute maps of the plan
+// **********************************************************************
+int print_usage(int argc, char *argv[])
+{
+  int32_t first, last;
+  if (usage_range(argc, argv, 2, &first, &last) != 0) {
+    fprintf(stderr, "Usage: lights433 usage [from YYYY-MM-DD [to YYYY-MM-DD]]\n");
+    return 1;
+  }
+  struct minute_map maps [7];
+  for (struct site *s : sites) {
+    struct plan_site ps;
+    site_plan(s, first, last, &ps);
+    auto t0 = std::chrono::steady_clock::now();
+    minute_compile(&ps, first, last, maps);
+    auto t1 = std::chrono::steady_clock::now();
+
+    if (sites.size() > 1)
+      std::printf("%s\n", s->name.c_str());
+    std::printf("hours    ");
+    for (int i = 0; i < 7; i++) {
+      if (ps.switches & (1u << i))
+        std::printf(" switch_%02d", i + 1);
+    }
+    std::printf("\n");
+
+    // one row per month (or part of one) of the range
+    int counts = 0;
+    for (int32_t d = first; d <= last; ) {
+      struct civil_date c = civil_from_days(d);
+      int32_t next = std::min(days_from_civil(c.year, c.month, 1) + cal_days_in_month(c.year, c.month), last + 1);
+      std::printf("%04d-%02d  ", c.year, c.month);
+      for (int i = 0; i < 7; i++) {
+        if (!(ps.switches & (1u << i)))
+          continue;
+        int64_t on = minute_count(&maps[i], NULL, MM_COUNT, minute_of_day(&maps[i], d), minute_of_day(&maps[i], next));
+        std::printf(" %9.1f", on / 60.0);
+        counts++;
+      }
+      std::printf("\n");
+      d = next;
+    }
+    std::printf("total    ");
+    for (int i = 0; i < 7; i++) {
+      if (ps.switches & (1u << i))
+        std::printf(" %9.1f", minute_count(&maps[i], NULL, MM_COUNT, 0, maps[i].minutes) / 60.0);
+    }
+    std::printf("\nkWh      ");
+    double kwh = 0;
+    for (int i = 0; i < 7; i++) {
+      if (!(ps.switches & (1u << i)))
+        continue;
+      double e = s->watts[i] * minute_count(&maps[i], NULL, MM_COUNT, 0, maps[i].minutes) / 60.0 / 1000.0;
+      std::printf(" %9.1f", e);
+      kwh += e;
+    }
+    std::printf("   (%.1f kWh in all)\n", kwh);
+
+    // hours on together
+    std::printf("\ntogether ");
+    for (int i = 0; i < 7; i++) {
+      if (ps.switches & (1u << i))
+        std::printf(" switch_%02d", i + 1);
+    }
+    std::printf("\n");
+    for (int i = 0; i < 7; i++) {
+      if (!(ps.switches & (1u << i)))
+        continue;
+      std::printf("switch_%02d", i + 1);
+      for (int j = 0; j < 7; j++) {
+        if (!(ps.switches & (1u << j)))
+          continue;
+        if (j <= i) {
+          std::printf(" %9s", "");
+        } else {
+          std::printf(" %9.1f", minute_count(&maps[i], &maps[j], MM_AND, 0, maps[i].minutes) / 60.0);
+          counts++;
+        }
+      }
+      std::printf("\n");
+    }
+    auto t2 = std::chrono::steady_clock::now();
+    std::printf("\n%d map(s) of %lld minutes (%zu kB each), compiled in %.1f ms, %d counts in %.1f ms\n\n",
+                __builtin_popcount(ps.switches), (long long) maps[0].minutes, maps[0].bits.size() * 8 / 1024,
+                std::chrono::duration<double, std::milli>(t1 - t0).count(), counts,
+                std::chrono::duration<double, std::milli>(t2 - t1).count());
+  }
+  return 0;
+}
+
+// **********************************************************************
+//    What changes with another configuration (a site file, or a directory
+//    of them): per site and switch the hours added and removed, the days
+//    affected and the energy, from the XOR of the per-minute maps
+// **********************************************************************
+int print_diff(int argc, char *argv[])
+{
+  int32_t first, last;
+  if (argc < 3 || usage_range(argc, argv, 3, &first, &last) != 0) {
+    fprintf(stderr, "Usage: lights433 diff <file or directory> [from YYYY-MM-DD [to YYYY-MM-DD]]\n");
+    return 1;
+  }
+  struct stat st;
+  std::vector<std::string> files;
+  if (stat(argv[2], &st) == 0 && S_ISDIR(st.st_mode))
+    files = site_files(argv[2]);
+  else
+    files.push_back(argv[2]);
+
+  std::vector<struct site *> other;
+  for (const std::string &f : files) {
+    struct site *o = new struct site();
+    o->file = f;
+    INIReader reader(f);
+    if (reader.ParseError() < 0 || read_site(reader, o) != 0) {
+      fprintf(stderr, "Can't load site %s\n", f.c_str());
+      delete o;
+      continue;
+    }
+    other.push_back(o);
+  }
+
+  struct minute_map a [7], b [7], x;
+  std::printf("%-24s %-9s %9s %9s %9s %6s %9s\n", "site", "switch", "changed h", "added h", "removed h", "days",
+              "kWh");
+  auto t0 = std::chrono::steady_clock::now();
+  std::vector<char> matched (other.size(), 0);
+  for (struct site *s : sites) {
+    size_t k = 0;
+    while (k < other.size() && other[k]->name != s->name)
+      k++;
+    if (k == other.size()) {
+      std::printf("%-24s only in the current configuration\n", s->name.c_str());
+      continue;
+    }
+    matched[k] = 1;
+    struct plan_site pa, pb;
+    site_plan(s, first, last, &pa);
+    site_plan(other[k], first, last, &pb);
+    minute_compile(&pa, first, last, a);
+    minute_compile(&pb, first, last, b);
+    for (int i = 0; i < 7; i++) {
+      minute_xor(&a[i], &b[i], &x);
+      int64_t changed = minute_count(&x, NULL, MM_COUNT, 0, x.minutes);
+      if (changed == 0)
+        continue;
+      int days = 0;
+      for (int32_t d = first; d <= last; d++)
+        days += minute_count(&x, NULL, MM_COUNT, minute_of_day(&x, d), minute_of_day(&x, d + 1)) > 0;
+      int64_t added   = minute_count(&b[i], &a[i], MM_ANDNOT, 0, x.minutes);
+      int64_t removed = minute_count(&a[i], &b[i], MM_ANDNOT, 0, x.minutes);
+      double kwh = (other[k]->watts[i] * minute_count(&b[i], NULL, MM_COUNT, 0, x.minutes) -
+                    s->watts[i] * minute_count(&a[i], NULL, MM_COUNT, 0, x.minutes)) / 60.0 / 1000.0;
+      std::printf("%-24.24s switch_%02d %9.1f %9.1f %9.1f %6d %+9.1f\n", s->name.c_str(), i + 1, changed / 60.0,
+                  added / 60.0, removed / 60.0, days, kwh);
+    }
+  }
+  for (size_t k = 0; k < other.size(); k++) {
+    if (!matched[k])
+      std::printf("%-24s only in %s\n", other[k]->name.c_str(), other[k]->file.c_str());
+    delete other[k];
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  std::printf("\n%.1f ms\n", std::chrono::duration<double, std::milli>(t1 - t0).count());
+  return 0;
+}
+
+// **********************************************************************
+//      Benchmarks of the hot paths: lights433 bench [counters] [case ...]
+//      With 'counters' every case is also measured with the hardware
+//      event counters (perfcount.h), where the kernel allows it.
+// **********************************************************************
+int run_bench(int argc, char *argv[])
+{
+  bool counters = false;
+  std::vector<std::string> only;
+  for (int k = 2; k < argc; k++) {
+    if (strcmp(argv[k], "counters") == 0)
+      counters = true;
+    else
+      only.push_back(argv[k]);
+  }
+
+  // a year of days at the first site (or at 40N 74W)
+  struct site *s0 = sites.empty() ? NULL : sites[0];
+  int tzone = s0 ? s0->tzone : -5;
+  struct civil_date today = civil_from_days(day_of_time(time(NULL), tzone));
+  int32_t first = days_from_civil(today.year, 1, 1);
+  std::vector<struct solar_input> in (365);
+  std::vector<struct solar_output> out (365);
+  for (int k = 0; k < 365; k++) {
+    struct civil_date c = civil_from_days(first + k);
+    in[k] = solar_input{ c.year, c.month, c.day, 12.0, s0 ? s0->xlat : 40.7, s0 ? s0->xlon : -74.0 };
+  }
+  struct plan_site ps;
+  if (s0)
+    site_plan(s0, first, first + 364, &ps);
+  // today's on and off time of every site
+  std::vector<time_t> on (sites.size()), off (sites.size());
+  for (size_t k = 0; k < sites.size(); k++) {
+    time_t t_sunset = calc_sunriseset(sites[k], SUNSET, time(NULL));
+    on [k] = calc_ontime(sites[k], t_sunset);
+    off[k] = calc_offtime(sites[k], t_sunset);
+  }
+
+  std::vector<struct bench_case> cases = {
+    { "solar", 365, [&]() { solar_calc(in, tzone, out, false); bench_keep(out[0]); } },
+    { "solar-fast", 365, [&]() { solar_calc(in, tzone, out, true); bench_keep(out[0]); } },
+    { "ini", 1, [&]() { INIReader reader(config_file); bench_keep(reader); } },
+  };
+  if (s0) {
+    cases.push_back({ "plan", 365, [&]() {
+      plan_days(&ps, first, first + 364, [&](const struct plan_day *d, int) { bench_keep(*d); });
+    } });
+    cases.push_back({ "nights", (long) sites.size(), [&]() {
+      for (size_t k = 0; k < sites.size(); k++)
+        plan_nights(sites[k], on[k], off[k]);
+    } });
+    cases.push_back({ "planned_state", (long) sites.size(), [&]() {
+      unsigned int mask = 0;
+      for (struct site *s : sites)
+        mask |= planned_state(s);
+      bench_keep(mask);
+    } });
+  }
+
+  if (!only.empty()) {
+    std::erase_if(cases, [&](const struct bench_case &c) {
+      return std::find(only.begin(), only.end(), c.name) == only.end();
+    });
+    if (cases.empty()) {
+      fprintf(stderr, "Usage: lights433 bench [counters] [solar|solar-fast|ini|plan|nights|planned_state ...]\n");
+      return 1;
+    }
+  }
+  return bench_run(cases, counters, BENCH_SECONDS);
+}
+
+// **********************************************************************
+//      Function to determine if the current time is within a given range
+// **********************************************************************
+int time_in_range(time_t a, time_t b)
+{
+  std::time_t tnow = std::time(NULL); 
+
+  if ( (difftime(tnow, a) > 0) && (difftime(b, tnow) > 0) )
+    return 1;
+  else 
+    return 0;
+}
 
 // **********************************************************************
 //      Get current date/time, format is YYYY-MM-DD.HH:mm:ss
@@ -215,63 +1322,414 @@ std::string currentDateTime() {
 
 // **********************************************************************
 //  Switch lights on/off, depending on LIGHTS_ON/OFF flag (defined in .h file)
+//  Every controlled switch runs its own sequence, so staggered switches do
+//  not hold up the others.
+// **********************************************************************
+task switch_lights(struct site *s, int flag, int cause)
+{
+  std::vector<task> sequences;
+  int i = 0;
+  for ( bool b : s->contolled_switches ) {
+    if (b) 
+      sequences.push_back(switch_one(s, i, flag, cause));
+    i+=1;
+  }
+  for (task &t : sequences)
+    co_await t;
+}
+
+// **********************************************************************
+//  Switch lights on/off, but only those whose last commanded state 
+//  differs from 'desired' (bit i set = switch i should be on)
 // **********************************************************************
-int switch_lights(int flag)
-{
-  int ret, i = 0;
-  for ( bool b : contolled_switches ) {
-    if (b) {
-      switch (flag) {
-        case LIGHTS_ON:
-          ret = send_code(code_on [i]);
-          break;
-        default:
-          ret = send_code(code_off[i]);
-          break;
+task reconcile_lights(struct site *s, unsigned int desired, int cause)
+{
+  std::vector<task> sequences;
+  int i = 0;
+
+  for ( bool b : s->contolled_switches ) {
+    bool is_on     = (s->switch_state >> i) & 1;
+    bool should_be = (desired >> i) & 1;
+    if (b && is_on != should_be)
+      sequences.push_back(switch_one(s, i, should_be ? LIGHTS_ON : LIGHTS_OFF, cause));
+    i+=1;
+  }
+  for (task &t : sequences)
+    co_await t;
+}
+
+// **********************************************************************
+//  Switch a single light on/off after its stagger delay
+// **********************************************************************
+task switch_one(struct site *s, int i, int flag, int cause)
+{
+  co_await delay(1000 * s->stagger[i]);
+  // the all-off sweep at start is the one thing that can wait for airtime
+  co_await transmit(flag == LIGHTS_ON ? s->code_on[i] : s->code_off[i], s->tx_mask[i], s->repeats[i], 
+                    cause != HIST_SWEEP);
+  set_switch_state(s, i, flag == LIGHTS_ON);
+  s->last_sent[i] = time(NULL);
+  health.codes_sent++;
+  record_event(s, i, flag, cause, s->tx_mask[i]);
+  update_status();
+}
+
+// **********************************************************************
+//  Add a switching event to the history. Planned changes also record
+//  the time they were planned for.
+// **********************************************************************
+void record_event(struct site *s, int i, int flag, int cause, unsigned int transmitters)
+{
+  struct history_record rec;
+  memset(&rec, 0, sizeof(rec));
+  rec.time         = time(NULL);
+  rec.transmitters = transmitters;
+  rec.site         = s->id;
+  rec.sw           = i;
+  rec.action       = flag;
+  rec.cause        = cause;
+
+  // latest planned change of this kind that has passed
+  if (cause == HIST_PLAN || cause == HIST_RESTORE) {
+    for (int k = 0; k < s->night[i].n; k++) {
+      time_t t = flag == LIGHTS_ON ? s->night[i].on[k] : s->night[i].off[k];
+      if (t <= rec.time && t > rec.planned)
+        rec.planned = t;
+    }
+    for (int k = 0; k < s->last_night[i].n; k++) {
+      time_t t = flag == LIGHTS_ON ? s->last_night[i].on[k] : s->last_night[i].off[k];
+      if (t <= rec.time && t > rec.planned)
+        rec.planned = t;
+    }
+  }
+  if (history_append(&rec) != 0) {
+    logthis("ERROR: Cannot append to the event history");
+    health.history_errors++;
+  }
+  eventbus_publish(BUS_SWITCHED, &rec);
+}
+
+// **********************************************************************
+//  Follow the event stream of the daemon and print every event as a 
+//  line (see eventbus_format()); 'all' starts with the events still in
+//  the ring
+// **********************************************************************
+int print_events(int argc, char *argv[])
+{
+  struct bus_subscriber sub;
+  struct bus_event ev;
+  char line [EVENTBUS_LINE];
+
+  std::string file = state_path(EVENTBUS_FILE);
+  if (eventbus_subscribe(&sub, file.c_str(), argc > 2 && strcmp(argv[2], "all") == 0) != 0) {
+    fprintf(stderr, "Cannot open the event stream %s (is lights433 running?)\n", file.c_str());
+    return 1;
+  }
+  uint64_t lost = 0;
+  for (;;) {
+    eventbus_wait(&sub, -1);
+    while (eventbus_read(&sub, &ev) == 1) {
+      if (sub.lost != lost) {
+        fprintf(stderr, "%llu event(s) lost\n", (unsigned long long) (sub.lost - lost));
+        lost = sub.lost;
       }
+      eventbus_format(&ev, line, sizeof(line));
+      fputs(line, stdout);
     }
-    i+=1;
+    fflush(stdout);
+  }
+  return 0;
+}
+
+// Next planned change of switch i after 'now' (0 = none planned):
+// tonight, last night (after midnight) or a day ahead
+static time_t next_change(const struct site *s, const struct plan_horizon *h, int i, int flag, time_t now)
+{
+  time_t next = 0;
+  auto consider = [&](const struct switch_night *n) {
+    for (int k = 0; k < n->n; k++) {
+      time_t t = flag == LIGHTS_ON ? n->on[k] : n->off[k];
+      if (t > now && (next == 0 || t < next))
+        next = t;
+    }
+  };
+  consider(&s->last_night[i]);
+  consider(&s->night[i]);
+  for (int32_t d = s->daynum + 1; next == 0 && h != NULL && d <= h->last; d++) {
+    const struct plan_day *pd = horizon_day(h, d);
+    if (pd != NULL && (pd->switches & (1u << i)))
+      consider(&pd->night[i]);
+  }
+  return next;
+}
+
+// **********************************************************************
+//  Write the state of all sites and the health counters to the status
+//  block (see status.h). Runs on the event loop.
+// **********************************************************************
+void update_status(void)
+{
+  static struct status_block next;
+  time_t now = time(NULL);
+  next.started = started;
+  next.updated = now;
+  next.pid     = (uint32_t) getpid();
+  next.sites   = (uint32_t) std::min<size_t>(sites.size(), STATUS_SITES);
+  health.rx_dropped = RX_PIN >= 0 ? receiver_dropped() : 0;
+  next.health  = health;
+
+  struct rcu_reader reader;
+  for (uint32_t k = 0; k < next.sites; k++) {
+    const struct site *s = sites[k];
+    const struct plan_horizon *h = s->horizon.load();
+    struct status_site *v = &next.site[k];
+    memset(v, 0, sizeof(*v));
+    strncpy(v->name, s->name.c_str(), STATUS_NAME - 1);
+    v->daynum        = s->daynum;
+    v->planned_until = h != NULL ? h->last : s->daynum;
+    v->t_ontime      = s->t_ontime;
+    v->t_offtime     = s->t_offtime;
+    unsigned int planned = planned_state(s);
+    for (int i = 0; i < 7; i++) {
+      struct status_switch *w = &v->sw[i];
+      w->controlled   = s->contolled_switches[i];
+      w->on           = (s->switch_state >> i) & 1;
+      w->planned      = (planned >> i) & 1;
+      w->overridden   = (s->override_mask >> i) & 1;
+      w->transmitters = s->tx_mask[i];
+      w->last_sent    = s->last_sent[i];
+      w->last_changed = s->last_changed[i];
+      if (s->contolled_switches[i]) {
+        w->next_on  = next_change(s, h, i, LIGHTS_ON, now);
+        w->next_off = next_change(s, h, i, LIGHTS_OFF, now);
+      }
+    }
+  }
+  status_publish(&next);
+}
+
+// time as YYYY-MM-DD HH:MM:SS, or '-'
+static const char *status_time(int64_t t, char *buffer)
+{
+  time_t tt = (time_t) t;
+  if (t == 0)
+    return "-";
+  std::strftime(buffer, CHARSIZE, "%Y-%m-%d %H:%M:%S", std::localtime(&tt));
+  return buffer;
+}
+
+// **********************************************************************
+//  Print the status block of the running daemon, once or every
+//  'seconds' (lights433 status [seconds])
+// **********************************************************************
+int print_status(int argc, char *argv[])
+{
+  char t1 [CHARSIZE], t2 [CHARSIZE], t3 [CHARSIZE];
+  std::string file = state_path(STATUS_FILE);
+  const struct status_block *b = status_map(file.c_str());
+  if (b == NULL) {
+    fprintf(stderr, "Cannot open the status block %s (is lights433 running?)\n", STATUS_FILE);
+    return 1;
+  }
+  double interval = argc > 2 ? atof(argv[2]) : 0;
+  struct status_block *st = new struct status_block;
+  while (1) {
+    if (status_read(b, st) != 0) {
+      fprintf(stderr, "The status block is being written all the time\n");
+      return 1;
+    }
+    bool running = st->pid != 0 && kill((pid_t) st->pid, 0) == 0;
+    std::printf("pid %u%s, started %s, updated %s (%lld s ago)\n", st->pid, running ? "" : " (not running)",
+                status_time(st->started, t1), status_time(st->updated, t2), (long long) (time(NULL) - st->updated));
+    std::printf("cycles %llu, sent %llu, received %llu, reloads %llu, history errors %llu, rx dropped %llu\n",
+                (unsigned long long) st->health.cycles, (unsigned long long) st->health.codes_sent,
+                (unsigned long long) st->health.codes_received, (unsigned long long) st->health.reloads,
+                (unsigned long long) st->health.history_errors, (unsigned long long) st->health.rx_dropped);
+    for (uint32_t k = 0; k < st->sites && k < STATUS_SITES; k++) {
+      const struct status_site *v = &st->site[k];
+      struct civil_date until = civil_from_days(v->planned_until);
+      std::printf("\n%s: on %s, off %s, planned until %04d-%02d-%02d\n", v->name, status_time(v->t_ontime, t1),
+                  status_time(v->t_offtime, t2), until.year, until.month, until.day);
+      std::printf("switch     state  plan  next on              next off             last sent\n");
+      for (int i = 0; i < 7; i++) {
+        const struct status_switch *w = &v->sw[i];
+        if (!w->controlled)
+          continue;
+        std::printf("switch_%02d  %-3s%s  %-4s  %-19s  %-19s  %s\n", i + 1, w->on ? "on" : "off",
+                    w->overridden ? "*" : " ", w->planned ? "on" : "off", status_time(w->next_on, t1),
+                    status_time(w->next_off, t2), status_time(w->last_sent, t3));
+      }
+    }
+    if (interval <= 0)
+      break;
+    std::printf("\n");
+    fflush(stdout);
+    std::this_thread::sleep_for(std::chrono::duration<double>(interval));
   }
-  return (ret);
+  delete st;
+  return 0;
 }
 
+// **********************************************************************
+//  Print the events between two dates (YYYY-MM-DD, 'to' is exclusive),
+//  optionally of one switch (1-7, 0 = all) and one site (by its name)
+// **********************************************************************
+int print_history(int argc, char *argv[])
+{
+  const char *causes[4] = { "plan", "restore", "sweep", "remote" };
+  struct tm tml;
+  time_t from = 0, to = time(NULL) + 1;
+
+  if (argc > 2) {
+    memset(&tml, 0, sizeof(tml));
+    if (strptime(argv[2], "%Y-%m-%d", &tml) == NULL) {
+      fprintf(stderr, "Usage: lights433 history [from YYYY-MM-DD [to YYYY-MM-DD [switch [site]]]]\n");
+      return 1;
+    }
+    tml.tm_isdst = -1;
+    from = mktime(&tml);
+  }
+  if (argc > 3) {
+    memset(&tml, 0, sizeof(tml));
+    if (strptime(argv[3], "%Y-%m-%d", &tml) == NULL) {
+      fprintf(stderr, "Usage: lights433 history [from YYYY-MM-DD [to YYYY-MM-DD [switch [site]]]]\n");
+      return 1;
+    }
+    tml.tm_isdst = -1;
+    to = mktime(&tml);
+  }
+  int sw = argc > 4 ? atoi(argv[4]) - 1 : -1;
+  int64_t site = -1;
+  if (argc > 5) {
+    for (struct site *s : sites) {
+      if (s->name == argv[5])
+        site = s->id;
+    }
+    if (site < 0) {
+      fprintf(stderr, "No site %s\n", argv[5]);
+      return 1;
+    }
+  }
+
+  std::string dir = state_path(HISTORY_DIR);
+  if (history_open(dir.c_str(), false) != 0) {
+    fprintf(stderr, "Cannot open the event history in %s\n", dir.c_str());
+    return 1;
+  }
+  long n = history_query(from, to, site, sw, [&causes](const struct history_record &r) {
+    char when [CHARSIZE], planned [CHARSIZE] = "";
+    time_t t = r.time;
+    std::strftime(when, CHARSIZE, "%Y-%m-%d %H:%M:%S", std::localtime(&t));
+    if (r.planned != 0) {
+      t = r.planned;
+      std::strftime(planned, CHARSIZE, "  (planned %H:%M:%S)", std::localtime(&t));
+    }
+    if (sites.size() > 1) {
+      // by the id, as the order of the sites may have changed since
+      const char *name = "?";
+      for (const struct site *s : sites) {
+        if (s->id == r.site)
+          name = s->name.c_str();
+      }
+      std::printf("%s  %-16s", when, name);
+    } else
+      std::printf("%s", when);
+    std::printf("  switch_%02d  %-3s  %-7s%s\n", r.sw + 1, r.action == LIGHTS_ON ? "on" : "off",
+                r.cause < 4 ? causes[r.cause] : "?", planned);
+  });
+  std::printf("%ld event(s)\n", n);
+  history_close();
+  return 0;
+}
 
 // **********************************************************************
-//      Function to send the 433MHz signal. Needs wiringPi library.
+//  Remember the commanded state of a switch, in memory and in the journal
 // **********************************************************************
-int send_code(int code)
+void set_switch_state(struct site *s, int i, bool on)
+{
+  if (on != (bool) ((s->switch_state >> i) & 1))
+    s->last_changed[i] = time(NULL);
+  if (on)
+    s->switch_state |=  (1u << i);
+  else
+    s->switch_state &= ~(1u << i);
+  journal_set_switch(&s->journal, i, on);
+}
+
+
+// **********************************************************************
+//      Send a burst of n codes on one transmitter. Needs wiringPi library.
+//      The frames of the codes are interleaved round by round; a code
+//      without a configured repeat count gets as many frames as the 
+//      channel model needs at that spacing. Returns the number of frames.
+// **********************************************************************
+int send_codes(struct transmitter *tx, const int *codes, int *repeats, int n)
 {  
-  int ret = 0;
   char buffer [CHARSIZE];     // character buffer for output
-    
-    #ifdef SEND
-    RCSwitch mySwitch = RCSwitch();
-    mySwitch.enableTransmit(PIN);
-    mySwitch.send(code, 24);  
-    #endif /* SEND */
-        
-    std::sprintf (buffer, "   Sending code: %d", code);
-    logthis(buffer);
+  int auto_repeats = tx->repeats > 0 ? tx->repeats : rf_repeats(&tx->channel, tx->delivery, n);
+  int total = 0;
+  for (int k = 0; k < n; k++) {
+    if (repeats[k] <= 0)
+      repeats[k] = auto_repeats;
+    total += repeats[k];
+  }
+  std::vector<int> order(total);
+  int frames = rf_interleave(repeats, n, order.data());
+  double airtime = 0;         // us
+  for (int j = 0; j < frames; j++) {
+    airtime += rf_frame_time(codes[order[j]], 24, 1);
+  }
 
-    std::this_thread::sleep_for(std::chrono::milliseconds(DELAY));
-    return ret;
+  #ifdef SEND
+  if (tx->realtime) {
+    // the whole burst as one pulse train, every edge on its deadline
+    std::vector<uint32_t> durations((size_t) frames * RF_MAX_PULSES);
+    int m = 0;
+    for (int j = 0; j < frames; j++)
+      m += pulse_train(codes[order[j]], 24, 1, durations.data() + m);
+    rt_send(tx->pin, durations.data(), m, 1, tx->simulate, NULL, &tx->jitter);
+  } else if (!tx->simulate) {
+    tx->rc.setRepeatTransmit(1);
+    for (int j = 0; j < frames; j++)
+      tx->rc.send(codes[order[j]], 24);  
+  } else {
+    std::this_thread::sleep_for(std::chrono::microseconds((long) airtime));
   }
+  #endif /* SEND */
+
+  for (int k = 0; k < n; k++) {
+    if (tx->realtime)
+      std::sprintf (buffer, "   Sending code: %d (%s%s, %d frames, max edge error %d us)", codes[k], 
+                    tx->name.c_str(), tx->simulate ? ", simulated" : "", repeats[k], (int) (tx->jitter.max / 1000));
+    else
+      std::sprintf (buffer, "   Sending code: %d (%s%s, %d frames)", codes[k], tx->name.c_str(), 
+                    tx->simulate ? ", simulated" : "", repeats[k]);
+    logthis(buffer);
+  }
+  if (n > 1) {
+    std::sprintf (buffer, "   %d codes interleaved in %d frames, %d ms (%s)", n, frames, (int) (airtime / 1000), 
+                  tx->name.c_str());
+    logthis(buffer);
+  }
+  return frames;
+}
 
  
 // **********************************************************************
 //      Function to determine the time to switch on the lights
 // **********************************************************************
-time_t calc_ontime(time_t sunset)
+time_t calc_ontime(const struct site *s, time_t sunset)
 { 
   char buffer [CHARSIZE];
-  int offset = on_offset; // time before/after sunset in minutes
-  struct tm *tml = localtime(&sunset);
-  tml->tm_min  = tml->tm_min + offset;
-  sunset = std::mktime(tml);
+  int offset = s->on_offset; // time before/after sunset in minutes
+  struct tm tml;
+  localtime_r(&sunset, &tml);
+  tml.tm_min  = tml.tm_min + offset;
+  sunset = std::mktime(&tml);
   
   // write to the log file
-  strftime(buffer,CHARSIZE,"The time to switch on is:  %d-%m-%Y %H:%M:%S%p",tml);
-  logthis(buffer);
+  strftime(buffer,CHARSIZE,"The time to switch on is:  %d-%m-%Y %H:%M:%S%p",&tml);
+  site_log(s, buffer);
 
   return (sunset); 
 }
@@ -279,20 +1737,27 @@ time_t calc_ontime(time_t sunset)
 // **********************************************************************
 //      Function to determine the time to switch the lights off
 // **********************************************************************
-time_t calc_offtime(time_t sunset)
+time_t calc_offtime(const struct site *s, time_t sunset)
 { 
   char buffer [CHARSIZE];
-  struct tm *tml = localtime (&sunset);
-  // generate random number
-  std::srand(time(NULL));
-  int offset = rand() % off_ofset + 1; // Random time in minutes after after offtime
-  tml->tm_hour = off_hour;   // Hour at which to switch off (24 hour format)
-  tml->tm_min  = off_min + offset;
-  sunset = std::mktime(tml);
+  struct tm tml;
+  localtime_r(&sunset, &tml);
+  // random minutes after (or before) the off time; the same for a given site and day
+  int offset = random_offset(s->id, -1, epoch_day(s, sunset), RANDOM_OFF_TIME, s->off_ofset);
+  tml.tm_hour = s->off_hour;   // Hour at which to switch off (24 hour format)
+  tml.tm_min  = s->off_min + offset;
+  time_t t_off = std::mktime(&tml);
+  // an off time before sunset (e.g. 00:30) is the next morning's
+  if (t_off <= sunset) {
+    tml.tm_mday += 1;
+    tml.tm_isdst = -1;
+    t_off = std::mktime(&tml);
+  }
+  sunset = t_off;
 
   // write to the log file
-  std::strftime(buffer,CHARSIZE,"The time to switch off is: %d-%m-%Y %H:%M:%S%p",tml);
-  logthis(buffer);
+  std::strftime(buffer,CHARSIZE,"The time to switch off is: %d-%m-%Y %H:%M:%S%p",&tml);
+  site_log(s, buffer);
 
   return (sunset);
 }
@@ -300,33 +1765,35 @@ time_t calc_offtime(time_t sunset)
 // **********************************************************************
 //      Function to determine today's sunset time
 // **********************************************************************
-time_t calc_sunriseset(int value)
+time_t calc_sunriseset(const struct site *s, int value, time_t when)
 {
   char buffer [CHARSIZE];     // character buffer for output
   time_t dt_sunrise;
   time_t dt_sunset;
 
-  // Variables used by AstroCalc4R
-  int nrec  =  1;   // some kind of counter
-  int day, month, year; 
-  double hhour, noon, astro_sunrise, astro_sunset, azimuth, zenith, eqtime, declin, daylength, par;
-
-  // temporary values for sunset/sunrise based on current date/time of system
-  dt_sunrise   = time(0);
-  dt_sunset    = time(0);
-  tm *sunrise  = localtime(&dt_sunrise);
-  tm *sunset   = localtime(&dt_sunset);
+  // temporary values for sunset/sunrise based on the given date/time
+  // (sites are planned in parallel, so localtime_r)
+  struct tm tm_sunrise, tm_sunset;
+  dt_sunrise   = when;
+  dt_sunset    = when;
+  tm *sunrise  = localtime_r(&dt_sunrise, &tm_sunrise);
+  tm *sunset   = localtime_r(&dt_sunset, &tm_sunset);
   int daylight_savings = sunset->tm_isdst;
 
-  // set up the values for a function call to AstroCalc4R
-  day   = sunset->tm_mday;        // day of month
-  month = 1 + sunset->tm_mon;     // month
-  year  = 1900 + sunset->tm_year; // year
-  hhour = sunset->tm_hour;        // hour in day
-
-  AstroCalc4R(&nrec, &tzone, &day, &month, &year, &hhour, &xlat, &xlon, \
-         &noon, &astro_sunrise, &astro_sunset, &azimuth, &zenith, \
-         &eqtime, &declin, &daylength, &par);  
+  // the position of the sun on the given day, at the given hour
+  struct solar_input in;
+  struct solar_output out;
+  in.day   = sunset->tm_mday;        // day of month
+  in.month = 1 + sunset->tm_mon;     // month
+  in.year  = 1900 + sunset->tm_year; // year
+  in.hour  = sunset->tm_hour;        // hour in day
+  in.lat   = s->xlat;
+  in.lon   = s->xlon;
+  solar_calc(std::span(&in, 1), s->tzone, std::span(&out, 1));
+  double astro_sunrise = out.sunrise, astro_sunset = out.sunset;
+  // no sunrise or sunset (polar day or night): both at noon, see plan_days()
+  if (!std::isfinite(astro_sunrise) || !std::isfinite(astro_sunset))
+    astro_sunrise = astro_sunset = out.noon;
   
   // Calculate the sunrise time
   sunrise->tm_hour = floor(astro_sunrise); 
@@ -348,12 +1815,11 @@ time_t calc_sunriseset(int value)
 
 
   // log the results
-  struct tm *tml = localtime(&dt_sunrise);
-  strftime(buffer,CHARSIZE,"Sunrise is at: %d-%m-%Y %H:%M:%S%p",tml);
-  logthis(buffer);
-  tml = localtime(&dt_sunset);
-  strftime(buffer,CHARSIZE,"Sunset is at:  %d-%m-%Y %H:%M:%S%p",tml);
-  logthis(buffer);
+  struct tm tml;
+  strftime(buffer,CHARSIZE,"Sunrise is at: %d-%m-%Y %H:%M:%S%p",localtime_r(&dt_sunrise, &tml));
+  site_log(s, buffer);
+  strftime(buffer,CHARSIZE,"Sunset is at:  %d-%m-%Y %H:%M:%S%p",localtime_r(&dt_sunset, &tml));
+  site_log(s, buffer);
 
   if (value == SUNSET)
     return dt_sunset;
@@ -361,65 +1827,352 @@ time_t calc_sunriseset(int value)
     return dt_sunrise;
 } 
 
-  int read_ini_file(string filename) {
+// **********************************************************************
+//    The shared part of the configuration: log, transmitters, receiver
+//    and where the site files are
+// **********************************************************************
+int read_ini_file(string filename) {
 
     INIReader reader(filename);
 
     if (reader.ParseError() < 0) {
-        std::cout << "Can't load " << filename << endl;
+        fprintf(stderr, "Can't load %s\n", filename.c_str());
         return 1;
     }
+    config_file = filename;
+    sites_dir   = reader.Get("sites", "dir", SITES_DIR);
+
+    // Log file and its rotation
+    long segment_size = reader.GetInteger("log", "segment_size", LOG_SEGMENT_SIZE);
+    long segments     = reader.GetInteger("log", "segments", LOG_SEGMENTS);
+    long max_size     = reader.GetInteger("log", "max_size", LOG_MAX_SIZE);
+    if (segment_size < 1 || segments < 0 || max_size < 0) {
+      fprintf(stderr, "Invalid [log] in %s: segment_size must be at least 1 (KB), segments and max_size "
+              "at least 0\n", filename.c_str());
+      return 1;
+    }
+    log_configure(state_path(reader.Get("log", "file", LOG_FILE).c_str()), segment_size, (int) segments, max_size);
+
+    // Transmitters: every [GPIO*] section
+    for (const std::pmr::string &name : reader.Sections()) {
+      if (strncasecmp(name.c_str(), "GPIO", 4) != 0)
+        continue;
+      std::string section(name);
+      int t = transmitter_add(section, reader.GetInteger(section, "pin", -1), 
+                              reader.GetBoolean(section, "simulate", false) || !state_dir.empty());
+      if (t < 0) {
+        fprintf(stderr, "Too many transmitters, ignoring [%s]\n", section.c_str());
+        continue;
+      }
+      struct transmitter *tx = transmitter_get(t);
+      tx->delay    = reader.GetInteger(section, "delay", DELAY);
+      tx->realtime = reader.GetBoolean(section, "realtime", false);
+      tx->priority = reader.GetInteger(section, "priority", RT_PRIORITY);
+      tx->cpu      = reader.GetInteger(section, "cpu", -1);
+      tx->repeats  = std::min(reader.GetInteger(section, "repeats", 0), (long) RF_MAX_REPEATS);
+      tx->channel.loss  = reader.GetReal(section, "frame_loss", RF_FRAME_LOSS);
+      tx->channel.burst = reader.GetReal(section, "burst", RF_BURST);
+      tx->delivery = reader.GetReal(section, "delivery", RF_DELIVERY);
+      duty_init(&tx->duty, reader.GetReal(section, "duty_cycle", DUTY_CYCLE), 
+                reader.GetInteger(section, "duty_window", DUTY_WINDOW));
+    }
+    RX_PIN = state_dir.empty() ? reader.GetInteger("receiver", "pin", -1) : -1;
+
+    return 0;
+}
+
+// **********************************************************************
+//    The configuration of one site: switches, location, cycle, vacation.
+//    Called from several threads, so it only touches its own site.
+// **********************************************************************
+int read_site(INIReader &reader, struct site *s) {
+
+    const char *switches[7] = { "switch_01", "switch_02", "switch_03", "switch_04", 
+                                "switch_05", "switch_06", "switch_ALL" };
+    for (int i = 0; i < 7; i++) {
+      s->code_on[i]            = reader.GetInteger(switches[i], "on_code", -1);
+      s->code_off[i]           = reader.GetInteger(switches[i], "off_code", -1);
+      s->contolled_switches[i] = reader.GetBoolean(switches[i], "controlled", true);
+      s->stagger[i]            = reader.GetInteger(switches[i], "stagger", 0);
+      s->repeats[i]            = std::min(reader.GetInteger(switches[i], "repeats", 0), (long) RF_MAX_REPEATS);
+      s->watts[i]              = reader.GetReal(switches[i], "watts", 0);
+      s->facade_azimuth[i]     = reader.GetReal(switches[i], "facade", -1);
+      s->facade_horizon[i]     = reader.GetReal(switches[i], "horizon", 0);
+      if (s->facade_azimuth[i] >= 0) {
+        facade_init(&s->walls[i], s->facade_azimuth[i], s->facade_horizon[i]);
+        s->facade_mask |= 1u << i;
+      }
+    }
+
+    // Vacation mode
+    s->name       = reader.Get("location", "site", reader.Get("location", "latitude", "") + "," + 
+                                           reader.Get("location", "longitude", ""));
+    s->id         = site_hash(s->name.c_str());
+    s->vacation_mode = reader.GetBoolean("vacation", "enabled", false);
+    s->vacation.on_jitter  = reader.GetInteger("vacation", "on_jitter",  20);
+    s->vacation.off_jitter = reader.GetInteger("vacation", "off_jitter", 30);
+    s->vacation.breaks     = reader.GetInteger("vacation", "breaks",      2);
+    s->vacation.break_min  = reader.GetInteger("vacation", "break_min",  10);
+    s->vacation.break_max  = reader.GetInteger("vacation", "break_max",  45);
+    const struct vacation_params &vp = s->vacation;
+    if (vp.on_jitter < 0 || vp.off_jitter < 0 || vp.breaks < 0 || vp.break_min < 0 || 
+        vp.on_jitter > OFF_OFFSET_MAX || vp.off_jitter > OFF_OFFSET_MAX || vp.break_max > OFF_OFFSET_MAX) {
+      fprintf(stderr, "Invalid [vacation] in %s: on_jitter, off_jitter, breaks, break_min and break_max must be 0 to %d\n",
+              s->file.c_str(), OFF_OFFSET_MAX);
+      return 1;
+    }
+    if (vp.break_max < vp.break_min) {
+      fprintf(stderr, "Invalid [vacation] in %s: break_max %d is shorter than break_min %d\n", s->file.c_str(),
+              vp.break_max, vp.break_min);
+      return 1;
+    }
 
-    code_on[0] = reader.GetInteger("switch_01",  "on_code", -1);
-    code_on[1] = reader.GetInteger("switch_02",  "on_code", -1);
-    code_on[2] = reader.GetInteger("switch_03",  "on_code", -1);
-    code_on[3] = reader.GetInteger("switch_04",  "on_code", -1);
-    code_on[4] = reader.GetInteger("switch_05",  "on_code", -1);
-    code_on[5] = reader.GetInteger("switch_06",  "on_code", -1);
-    code_on[6] = reader.GetInteger("switch_ALL", "on_code", -1);
-
-    code_off[0] = reader.GetInteger("switch_01",  "off_code", -1);
-    code_off[1] = reader.GetInteger("switch_02",  "off_code", -1);
-    code_off[2] = reader.GetInteger("switch_03",  "off_code", -1);
-    code_off[3] = reader.GetInteger("switch_04",  "off_code", -1);
-    code_off[4] = reader.GetInteger("switch_05",  "off_code", -1);
-    code_off[5] = reader.GetInteger("switch_06",  "off_code", -1);
-    code_off[6] = reader.GetInteger("switch_ALL", "off_code", -1);
-
-    contolled_switches [0] = reader.GetBoolean("switch_01", "controlled", true);
-    contolled_switches [1] = reader.GetBoolean("switch_02", "controlled", true);
-    contolled_switches [2] = reader.GetBoolean("switch_03", "controlled", true);
-    contolled_switches [3] = reader.GetBoolean("switch_04", "controlled", true);
-    contolled_switches [4] = reader.GetBoolean("switch_05", "controlled", true);
-    contolled_switches [5] = reader.GetBoolean("switch_06", "controlled", true);
-    contolled_switches [6] = reader.GetBoolean("switch_ALL", "controlled", true);
-
-    PIN = reader.GetInteger("GPIO0", "pin", -1);
+    // Transmitters of each switch (default: all of them)
+    for (int i = 0; i < 7; i++) {
+      std::string names = reader.Get(switches[i], "transmitters", "");
+      s->tx_mask[i] = names.empty() ? transmitter_all() : 0;
+      for (size_t start = 0; start < names.size(); ) {
+        size_t end = names.find(',', start);
+        if (end == std::string::npos)
+          end = names.size();
+        std::string name = names.substr(start, end - start);
+        name.erase(0, name.find_first_not_of(" \t"));
+        name.erase(name.find_last_not_of(" \t") + 1);
+        int t = transmitter_find(name);
+        if (t >= 0)
+          s->tx_mask[i] |= (1u << t);
+        else
+          fprintf(stderr, "Unknown transmitter '%s' in [%s] of %s\n", name.c_str(), switches[i], 
+                  s->file.c_str());
+        start = end + 1;
+      }
+    }
 
     // Variables specific to current location (used in AstroCalc4R)
-    xlat   = reader.GetReal("location", "latitude",    -1);    // Chappaqua, NY is Latitude:   41.157775
-    xlon   = reader.GetReal("location", "longitude",   -1) ;   //                  Longitude: -73.788873
-    tzone  = reader.GetInteger("location", "timezone", -1);    // Hours from GST (EST = -5)
+    s->xlat   = reader.GetReal("location", "latitude",    -1);    // Chappaqua, NY is Latitude:   41.157775
+    s->xlon   = reader.GetReal("location", "longitude",   -1) ;   //                  Longitude: -73.788873
+    s->tzone  = reader.GetInteger("location", "timezone", -1);    // Hours from GST (EST = -5)
+    // daylight saving comes from the host's time zone (localtime()), so
+    // a site in another zone is planned in the host's
+    long host = host_standard_offset();
+    if (3600L * s->tzone != host) {
+      char buffer [LOG_LINE];
+      snprintf(buffer, sizeof(buffer), "WARNING: timezone in %s is %d, but the host's time zone (TZ) is %+.1f "
+               "hours from GMT; %s", s->file.c_str(), s->tzone, host / 3600.0,
+               host % 3600 == 0 ? "using the host's" : "daylight saving may be an hour out");
+      fprintf(stderr, "%s\n", buffer);
+      logthis(buffer);
+      if (host % 3600 == 0)
+        s->tzone = (int) (host / 3600);
+    }
 
     // Variables to control lights on/off cycle
-    std::string s_ontime = reader.Get("Cycle_01", "on_time", "UNKNOWN");
     std::string s_offtime = reader.Get("Cycle_01", "off_time", "UNKNOWN");
-    on_offset = reader.GetInteger("Cycle_01", "on_offset", -1);              // minutes before sunset
-    off_ofset  = reader.GetInteger("Cycle_01", "off_offset", -1); 
+    s->on_offset = reader.GetInteger("Cycle_01", "on_offset", -1);              // minutes before sunset
+    s->off_ofset = reader.GetInteger("Cycle_01", "off_offset", 0);              // minutes before (< 0) or after the off time
+    if (s->off_ofset < -OFF_OFFSET_MAX || s->off_ofset > OFF_OFFSET_MAX) {
+      fprintf(stderr, "Invalid off_offset in %s: %d (at most %d minutes either way)\n", s->file.c_str(),
+              s->off_ofset, OFF_OFFSET_MAX);
+      return 1;
+    }
 
     std::string delimiter = ":";
-    on_hour =  std::stoi(  s_ontime.substr(0, s_ontime.find(delimiter)) );
-    std::string s = s_ontime.substr( s_ontime.find(delimiter)+1, s_ontime.length() );
-    on_min  =  std::stoi(  s ) ;
-
     try {
-      off_hour =  std::stoi(  s_offtime.substr(0, s_offtime.find(delimiter)) );
-      s = s_offtime.substr( s_offtime.find(delimiter)+1, s_offtime.length() );
-      off_min  =  std::stoi(  s ) ;
+      s->off_hour =  std::stoi(  s_offtime.substr(0, s_offtime.find(delimiter)) );
+      s->off_min  =  std::stoi(  s_offtime.substr( s_offtime.find(delimiter)+1, s_offtime.length() ) );
     }
     catch (const std::invalid_argument& ia) {
-      std::cerr << "Invalid argument in ini file: " << ia.what() << '\n';
+      fprintf(stderr, "Invalid argument in %s: %s\n", s->file.c_str(), ia.what());
+      return 1;
+    }
+
+    // Day rules, compiled for the years around today
+    for (const std::string &name : reader.Keys("calendar")) {
+      if (daycal_add(&s->calendar, name, reader.Get("calendar", name, "")) < 0)
+        return 1;
+    }
+    for (int i = 0; i < 7; i++) {
+      std::string days = reader.Get(switches[i], "days", "");
+      s->days_rule[i] = days.empty() ? -1 : daycal_rule(&s->calendar, days);
+      if (!days.empty() && s->days_rule[i] < 0)
+        return 1;
+    }
+    // Time rules: [Cycle_01] for every switch, [switch_*] for one
+    // (compiled before the day rules they name)
+    std::string error;
+    for (int i = 0; i < 7; i++) {
+      const char *keys[2] = { "on_rule", "off_rule" };
+      struct time_rule *rules[2] = { &s->on_rule[i], &s->off_rule[i] };
+      for (int j = 0; j < 2; j++) {
+        std::string text = reader.Get(switches[i], keys[j], reader.Get("Cycle_01", keys[j], ""));
+        if (text.empty())
+          continue;
+        if (rule_compile(rules[j], text, RANDOM_RULES + 0x100 * j, &s->calendar, &error) != 0) {
+          fprintf(stderr, "Invalid %s in %s: %s\n", keys[j], s->file.c_str(), error.c_str());
+          return 1;
+        }
+      }
+    }
+    // on_time is not a rule: a switch without an on_rule goes on at sunset + on_offset
+    std::string on_time = reader.Get("Cycle_01", "on_time", "");
+    if (!on_time.empty()) {
+      for (int i = 0; i < 7; i++) {
+        if (!s->contolled_switches[i] || !rule_empty(&s->on_rule[i]))
+          continue;
+        char buffer [LOG_LINE];
+        snprintf(buffer, sizeof(buffer), "WARNING: on_time in %s is not used; switches go on at sunset + "
+                 "on_offset, or write e.g. 'on_rule = max(sunset - 15m, %s)'", s->file.c_str(), on_time.c_str());
+        fprintf(stderr, "%s\n", buffer);
+        logthis(buffer);
+        break;
+      }
     }
+    std::string days = reader.Get("vacation", "days", "");
+    s->vacation_days = days.empty() ? -1 : daycal_rule(&s->calendar, days);
+    if (!days.empty() && s->vacation_days < 0)
+      return 1;
+    int32_t today = day_of_time(time(NULL), s->tzone);
+    if (!s->calendar.rules.empty() &&
+        daycal_compile(&s->calendar, today - 366 * CAL_YEARS_BEFORE, today + 366 * CAL_YEARS_AFTER) != 0)
+      return 1;
     
     return 0;
-  }
\ No newline at end of file
+}
+
+// **********************************************************************
+//    Offset of the host's standard time from GMT (in seconds): the
+//    smaller of the offsets in January and in July of this year
+// **********************************************************************
+long host_standard_offset(void)
+{
+  struct tm tml;
+  time_t now = time(NULL);
+  time_t jan = (time_t) days_from_civil(gmtime_r(&now, &tml)->tm_year + 1900, 1, 15) * 86400;
+  time_t jul = jan + 181 * 86400;
+  localtime_r(&jan, &tml);
+  long offset = tml.tm_gmtoff;
+  localtime_r(&jul, &tml);
+  return std::min(offset, (long) tml.tm_gmtoff);
+}
+
+// **********************************************************************
+//    The *.conf files of a directory, in the order of their names
+// **********************************************************************
+std::vector<std::string> site_files(const char *dir) {
+
+    std::vector<std::string> names;
+    DIR *d = opendir(dir);
+    if (d != NULL) {
+      while (struct dirent *e = readdir(d)) {
+        size_t len = strlen(e->d_name);
+        if (e->d_name[0] != '.' && len > 5 && strcmp(e->d_name + len - 5, ".conf") == 0)
+          names.push_back(e->d_name);
+      }
+      closedir(d);
+    }
+    std::sort(names.begin(), names.end());
+    for (std::string &n : names)
+      n = std::string(dir) + "/" + n;
+    return names;
+}
+
+// **********************************************************************
+//    Find the sites: the main configuration if it has a [location],
+//    then every *.conf in dir, in the order of their names. The files are
+//    parsed (and, for the daemon, planned and restored from their
+//    journals) by a few threads; sites are independent of each other.
+//    The sites that could not be read are dropped before the others are
+//    prepared.
+// **********************************************************************
+int load_sites(const char *dir, bool prepare) {
+
+    std::vector<std::string> files;
+    {
+      INIReader main_reader(config_file);
+      if (!main_reader.Get("location", "latitude", "").empty())
+        files.push_back(config_file);
+    }
+    for (const std::string &f : site_files(dir))
+      files.push_back(f);
+
+    for (size_t k = 0; k < files.size(); k++) {
+      struct site *s = new struct site();
+      s->file          = files[k];
+      s->index         = (int) k;
+      s->journal.fd    = -1;
+      s->journal.slots = NULL;
+      sites.push_back(s);
+    }
+
+    // run 'each' for every site on a few threads
+    auto parallel = [](const std::function<void(size_t)> &each) {
+      std::atomic<size_t> next(0);
+      auto worker = [&]() {
+        for (size_t k = next++; k < sites.size(); k = next++)
+          each(k);
+      };
+      unsigned nthreads = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), sites.size());
+      std::vector<std::thread> threads;
+      for (unsigned t = 1; t < nthreads; t++)
+        threads.emplace_back(worker);
+      worker();
+      for (std::thread &t : threads)
+        t.join();
+    };
+
+    std::vector<char> ok(sites.size(), 0);
+    std::atomic<int> errors(0);
+    parallel([&](size_t k) {
+      struct site *s = sites[k];
+      INIReader reader(s->file);
+      if (reader.ParseError() < 0 || read_site(reader, s) != 0) {
+        fprintf(stderr, "Can't load site %s\n", s->file.c_str());
+        errors++;
+        return;
+      }
+      ok[k] = 1;
+    });
+
+    // drop the sites that could not be read, and number the others again
+    if (errors > 0) {
+      std::vector<struct site *> good;
+      for (size_t k = 0; k < sites.size(); k++) {
+        if (ok[k]) {
+          sites[k]->index = (int) good.size();
+          good.push_back(sites[k]);
+        } else {
+          delete sites[k];
+        }
+      }
+      sites = good;
+    }
+    if (prepare)
+      parallel([](size_t k) { prepare_site(sites[k]); });
+    return errors > 0 ? 1 : 0;
+}
+
+// **********************************************************************
+//    The main configuration and every site
+// **********************************************************************
+int read_config(bool prepare) {
+    // a simulation reads its own lights433.conf, if there is one
+    std::string file = state_path(CONFIG_FILE);
+    if (state_dir.empty() || access(file.c_str(), R_OK) != 0)
+      file = CONFIG_FILE;
+    if (read_ini_file(file) != 0)
+      return 1;
+    return load_sites(sites_dir.c_str(), prepare);
+}
+
+// **********************************************************************
+//    Where the daemon keeps a file of its state (journal, history, event
+//    stream, status, socket, log): 'path' itself, or for a simulation
+//    its name in the state directory
+// **********************************************************************
+std::string state_path(const char *path)
+{
+  if (state_dir.empty())
+    return path;
+  const char *name = strrchr(path, '/');
+  return state_dir + "/" + (name != NULL ? name + 1 : path);
+}
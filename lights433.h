@@ -4,18 +4,43 @@
 #define RPI 1
 #include "../433Utils/rc-switch/RCSwitch.h"
 #include "INIReader.h"
+#include "journal.h"
+#include "history.h"
+#include "eventbus.h"
+#include "logger.h"
+#include "eventloop.h"
+#include "vacation.h"
+#include "receiver.h"
+#include "pulsetrain.h"
+#include "rfmodel.h"
+#include "realtime.h"
+#include "transmitter.h"
+#include "planexport.h"
+#include "minutemap.h"
+#include "rcu.h"
+#include "solar.h"
+#include "calendar.h"
+#include "suntrack.h"
+#include "daycal.h"
+#include "timerule.h"
+#include "horizon.h"
+#include "status.h"
+#include "bench.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
-#include <random>
 #include <ctime>
-#include <iostream>
-#include <fstream>
 #include <chrono>
-#include <iomanip> 
 #include <thread>	
-#include <sstream>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <dirent.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <unistd.h>
 //#include "easylogging++.h"    // logging: https://github.com/easylogging/easyloggingpp
 //INITIALIZE_EASYLOGGINGPP
 
@@ -27,17 +52,161 @@
 #define SUNSET 2
 #define CHARSIZE 80
 #define CYCLE 60000		// Cycle time in ms 
-#define DELAY 5000		// Delay between 433MHz signals (in ms)
+#define SOLAR_ERROR_BUDGET 5.0	// Allowed error of the fast solar kernel (in seconds)
+#define DELAY -1		// Gap after a burst on the same pin (in ms, -1 = TX_GAP_FRAMES frames)
+#define OFF_OFFSET_MAX 720	// Largest random offset of the off time, vacation jitter or break (in minutes)
 
-time_t calc_sunriseset ( int );
-time_t calc_ontime ( time_t );
-time_t calc_offtime( time_t );
+#define CONFIG_FILE "/etc/lights433.conf"
+#define SITES_DIR   "/etc/lights433.d"	// one more site per *.conf file
+
+// One site (household): its switches, location, plan and state
+struct site {
+  std::string name;         // [location] site, or "lat,lon"
+  std::string file;         // configuration file
+  int      index;           // position in 'sites' (changes when site files come and go)
+  uint32_t id;              // hash of the name, seeds the random numbers and names the
+                            // site in the event history and stream
+
+  // Switch on/off codes, whether they are controlled, their delay (in 
+  // seconds) after an on/off event, the transmitters they are sent on
+  // and their frames per code (0 = the transmitter's)
+  int  code_on  [7];
+  int  code_off [7];
+  bool contolled_switches [7];
+  int  stagger [7];
+  unsigned int tx_mask [7];
+  int  repeats [7];
+  double watts [7];         // power of what the switch turns on (for 'lights433 usage')
+
+  // Location (used in AstroCalc4R)
+  double xlat;              // Latitude
+  double xlon;              // Longitude
+  int    tzone;             // Hours from GST (e.g. EST = -5)
+
+  // Lights on/off cycle
+  int on_offset;            // offset (in minutes) before/after sunset
+  int off_hour, off_min;    // Time to switch off (24 hour format)
+  int off_ofset;            // Randomized offset (in minutes, < 0: before the off time)
+
+  // Vacation mode (occupancy simulation)
+  bool vacation_mode;
+  struct vacation_params vacation;
+
+  // Day rules ([calendar]): the days each switch is planned on and the
+  // days of vacation mode besides 'enabled' (-1 = no rule)
+  struct day_calendar calendar;
+  int days_rule [7];
+  int vacation_days;
+
+  // On and off time rules of the switches (on_rule/off_rule; empty: the
+  // on_offset after sunset and the off time above)
+  struct time_rule on_rule [7], off_rule [7];
+
+  // Today's plan and the state of the switches
+  int    daynum;                   // day (since the epoch) of the plan
+  time_t t_ontime, t_offtime;      // on/off times of the plan
+  struct switch_night night [7];   // on-intervals of each switch
+  struct switch_night last_night [7];   // ... of the day before (may end after midnight)
+  rcu_ptr<struct plan_horizon> horizon; // the plan of the next days
+  int32_t horizon_asked;           // day the horizon was last extended on
+  unsigned int switch_state;       // last commanded state (bit i = switch i on)
+  time_t last_sent [7];            // last time a code was sent for the switch
+  time_t last_changed [7];         // ... and its state changed
+  unsigned int override_mask;      // switches set by hand on the remote
+  struct journal journal;
+  bool   restored;                 // state was read back from the journal
+
+  // Facade rules: a switch also goes on when the sun leaves the facade
+  // its windows face, in the afternoon (azimuth < 0 = no rule)
+  double facade_azimuth [7];
+  double facade_horizon [7];
+  struct facade walls [7];
+  unsigned int facade_mask;        // switches with a facade rule
+  task         facade;             // facade_loop() of the site (done: none runs)
+  int32_t      facade_day;         // day of the two masks below
+  unsigned int facade_lit;         // facades the sun has shone on this afternoon
+  unsigned int facade_dark;        // ... and has left since
+
+  unsigned int reloads;            // reload requests (SIGHUP) handled so far
+};
+
+extern std::vector<struct site *> sites;
+
+// What the configuration and plan of a site look like to other threads.
+// Never changed once published; see publish_plan().
+struct site_snapshot {
+  std::string  name;
+  int          index;
+  uint32_t     id;
+  unsigned int controlled;         // bit i = switch i is controlled
+  int          code_on  [7];
+  int          code_off [7];
+  unsigned int tx_mask  [7];
+  double       lat, lon;
+  int          tzone;
+  int32_t      daynum;             // day of the plan
+  time_t       t_ontime, t_offtime;
+  struct switch_night night [7];
+};
+
+struct plan_snapshot {
+  uint64_t generation;             // 1 for the first, +1 for every publish_plan()
+  time_t   published;
+  std::vector<struct site_snapshot> sites;
+};
+
+extern rcu_ptr<struct plan_snapshot> current_plan;
+
+time_t calc_sunriseset ( const struct site *, int, time_t );
+time_t calc_ontime ( const struct site *, time_t );
+time_t calc_offtime( const struct site *, time_t );
 int time_in_range(time_t, time_t);
-int switch_lights( int );
-int send_code( int );
-int daynumber( time_t ); 
+void plan_day( struct site *, time_t );
+void publish_plan( void );
+std::string plan_greeting( void );
+int reload_site( struct site * );
+task control_loop( struct site * );
+task facade_loop( struct site * );
+unsigned int facade_update( struct site *, const struct sun_tracker * );
+task switch_lights( struct site *, int, int );
+task reconcile_lights( struct site *, unsigned int, int );
+task switch_one( struct site *, int, int, int );
+void record_event( struct site *, int, int, int, unsigned int );
+int print_events(int, char **);
+int print_status( int, char ** );
+void update_status( void );
+int print_history( int, char ** );
+void set_switch_state( struct site *, int, bool );
+void plan_nights( struct site *, time_t, time_t );
+void publish_nights( const struct site * );
+unsigned int planned_state( const struct site * );
+unsigned int controlled_mask( const struct site * );
+int32_t epoch_day( const struct site *, time_t );
+int print_vacation_plan( int );
+int print_calendar( int, char ** );
+int print_rules( void );
+long host_standard_offset( void );
+int export_plan( int, char ** );
+void site_plan( struct site *, int32_t, int32_t, struct plan_site * );
+struct horizon_job *site_job( const struct site *, int32_t, int32_t );
+void plan_horizon( struct site *, int32_t );
+void extend_horizon( struct site * );
+int print_usage( int, char ** );
+int print_diff( int, char ** );
+int run_bench( int, char ** );
+void code_index_sites(void);
+void received_code( const struct rx_code & );
+int receive_tool( int, char ** );
+int send_codes( struct transmitter *, const int *, int *, int );
 std::string currentDateTime(void);
-int logthis(std::string);
+int logthis(const char *);
+void site_log( const struct site *, const char * );
+extern bool logging;
+extern std::recursive_mutex log_lock;
 int read_ini_file(std::string);
-void AstroCalc4R(int *, int *, int *,int *,int *, double *,double *,double *, \
-				double *,double *,double *,double *,double *, double *,double *, double *, double *);
+int read_site(INIReader &, struct site *);
+std::vector<std::string> site_files(const char *);
+int load_sites(const char *, bool);
+int read_config(bool);
+std::string state_path(const char *);
+int fastmath_check(double);
@@ -0,0 +1,200 @@
+/*
+logger.cpp 
+
+Minimalist logging system with rotation.
+
+The current segment stays open between messages; it is only reopened once
+an hour (so that a moved or deleted file is recreated) or when it is full.
+A full segment is renamed to <file>.YYYYmmdd-HHMMSSZ-NN, in UTC so that
+the names sort by age across a change of daylight saving (NN counts the
+segments closed within the same second, so no name is used twice while
+the older one may still be compressed) and a background
+thread at the lowest CPU priority compresses it to .gz with zlib, then 
+deletes the oldest closed segments beyond the configured count and size.
+*/
+
+#include "lights433.h"
+#include <zlib.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <algorithm>
+
+static std::string log_file     = LOG_FILE;
+static long        segment_size = 1024L * LOG_SEGMENT_SIZE;
+static int         max_segments = LOG_SEGMENTS;
+static long        max_size     = 1024L * LOG_MAX_SIZE;
+
+static int    log_fd   = -1;
+static long   log_size = 0;      // bytes in the current segment
+static time_t log_hour = -1;     // hour the segment was opened in
+
+// **********************************************************************
+//      Set file name and limits (sizes in KB)
+// **********************************************************************
+void log_configure(const std::string &file, long segment_kb, int segments, long max_kb)
+{
+  std::lock_guard<std::recursive_mutex> guard(log_lock);
+  if (file != log_file && log_fd >= 0) {
+    close(log_fd);
+    log_fd = -1;
+  }
+  log_file     = file;
+  segment_size = 1024 * segment_kb;
+  max_segments = segments;
+  max_size     = 1024 * max_kb;
+}
+
+// **********************************************************************
+//      Delete the oldest closed segments beyond the count and size limits
+// **********************************************************************
+static void log_prune(void)
+{
+  std::string dir  = log_file.substr(0, log_file.rfind('/') + 1);
+  std::string base = log_file.substr(log_file.rfind('/') + 1) + ".";
+  std::vector<std::string> segments;
+
+  DIR *d = opendir(dir.empty() ? "." : dir.c_str());
+  if (d == NULL)
+    return;
+  while (struct dirent *e = readdir(d)) {
+    if (strncmp(e->d_name, base.c_str(), base.size()) == 0)
+      segments.push_back(dir + e->d_name);
+  }
+  closedir(d);
+
+  // names carry the time stamp (UTC): newest first
+  std::sort(segments.rbegin(), segments.rend());
+  long total = 0;
+  for (size_t i = 0; i < segments.size(); i++) {
+    struct stat st;
+    if (stat(segments[i].c_str(), &st) != 0)
+      continue;
+    total += st.st_size;
+    if ((int) i >= max_segments || total > max_size)
+      unlink(segments[i].c_str());
+  }
+}
+
+// **********************************************************************
+//      Compress a closed segment (runs in its own thread)
+// **********************************************************************
+static void log_compress(std::string segment)
+{
+  static std::mutex one_at_a_time;
+  std::lock_guard<std::mutex> guard(one_at_a_time);
+
+  // lowest priority: compression must never delay switching
+  setpriority(PRIO_PROCESS, syscall(SYS_gettid), 19);
+
+  std::string gz = segment + ".gz";
+  int in = open(segment.c_str(), O_RDONLY);
+  gzFile out = gzopen(gz.c_str(), "wb9");
+  if (in >= 0 && out != NULL) {
+    char buffer [16384];
+    ssize_t n;
+    bool ok = true;
+    while ((n = read(in, buffer, sizeof(buffer))) > 0)
+      ok = ok && gzwrite(out, buffer, (unsigned) n) == n;
+    if (gzclose(out) == Z_OK && ok && n == 0)
+      unlink(segment.c_str());
+    else
+      unlink(gz.c_str());
+  } else if (out != NULL) {
+    gzclose(out);
+    unlink(gz.c_str());
+  }
+  if (in >= 0)
+    close(in);
+  log_prune();
+}
+
+// **********************************************************************
+//      Close the current segment and start compressing it
+// **********************************************************************
+static void log_rotate(void)
+{
+  char stamp [CHARSIZE];
+  time_t now = time(NULL);
+  struct tm tml;
+  size_t len = strftime(stamp, CHARSIZE, ".%Y%m%d-%H%M%SZ", gmtime_r(&now, &tml));
+
+  close(log_fd);
+  log_fd = -1;
+  // link() does not replace an existing name; a segment of the same
+  // second is either still there or already compressed to .gz
+  for (int k = 0; k < 100; k++) {
+    snprintf(stamp + len, CHARSIZE - len, "-%02d", k);
+    std::string segment = log_file + stamp;
+    struct stat st;
+    if (stat(segment.c_str(), &st) == 0 || stat((segment + ".gz").c_str(), &st) == 0)
+      continue;
+    if (link(log_file.c_str(), segment.c_str()) == 0) {
+      unlink(log_file.c_str());
+    } else if (errno == EEXIST) {
+      continue;
+    } else if (rename(log_file.c_str(), segment.c_str()) != 0) {   // no hard links here
+      return;
+    }
+    std::thread(log_compress, segment).detach();
+    return;
+  }
+}
+
+// **********************************************************************
+//      Append a message to the log
+// **********************************************************************
+int logthis(const char *messg)
+{
+  char logmessg [LOG_LINE];
+
+  if (!logging)
+    return 0;
+  std::lock_guard<std::recursive_mutex> guard(log_lock);
+
+  // time stamp and message in a fixed buffer, so logging does not allocate
+  time_t now = time(NULL);
+  ctime_r(&now, logmessg);
+  size_t len = strlen(logmessg) - 1;          // without the \n at the end
+  len += snprintf(logmessg + len, sizeof(logmessg) - len, ": %s\n", messg);
+  if (len >= sizeof(logmessg)) {              // truncated: keep the newline
+    len = sizeof(logmessg) - 1;
+    logmessg[len - 1] = '\n';
+  }
+
+  // reopen once an hour and when the segment is full
+  if (log_fd >= 0 && (now / 3600 != log_hour || log_size + (long) len > segment_size)) {
+    if (log_size + (long) len > segment_size)
+      log_rotate();
+    else {
+      close(log_fd);
+      log_fd = -1;
+    }
+  }
+  if (log_fd < 0) {
+    log_fd = open(log_file.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if (log_fd < 0) {
+      fprintf(stderr, "Cannot open the log file %s\n", log_file.c_str());
+      return 1;
+    }
+    struct stat st;
+    log_size = fstat(log_fd, &st) == 0 ? st.st_size : 0;
+    log_hour = now / 3600;
+  }
+
+  if (write(log_fd, logmessg, len) != (ssize_t) len) {
+    fprintf(stderr, "Cannot write to the log file %s\n", log_file.c_str());
+    return 1;
+  }
+  log_size += len;
+
+  // log all messages also to screen if VERBOSE is set
+  #ifdef VERBOSE
+  fputs(logmessg, stdout);
+  #endif
+  return 0; 
+}
@@ -0,0 +1,23 @@
+/* 
+	logger.h
+
+	Size-bounded, segmented log. Messages are appended to the current
+	segment; when it reaches its size limit it is closed, renamed with a
+	time stamp and compressed in the background. The oldest segments are
+	deleted to keep within a maximum count and total size, so disk usage
+	is bounded without an external logrotate.
+*/
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <string>
+
+#define LOG_FILE          "/var/log/lights433.log"
+#define LOG_SEGMENT_SIZE  1024		// size of a segment (in KB)
+#define LOG_SEGMENTS      10		// closed segments to keep
+#define LOG_MAX_SIZE      4096		// total size of the closed segments (in KB)
+#define LOG_LINE          512		// longest line, longer messages are cut
+
+void log_configure(const std::string &, long, int, long);
+
+#endif
@@ -0,0 +1,50 @@
+#!/bin/sh
+#
+# measure.sh - footprint of a lights433 binary
+#
+# Usage: ./measure.sh [binary] [seconds]
+#
+# Prints the file size, the cold start time (reading the configuration and
+# planning a night, as 'lights433 plan' does) and the resident memory of the
+# daemon after it has run for a while (default 10 s). The daemon runs as a
+# simulation ('lights433 simulate'): it sends nothing and keeps its state in
+# a directory of its own, so a running lights433 is not disturbed. Compare e.g.
+#   ./measure.sh ./lights433 && ./measure.sh ./lights433-small
+
+BIN=${1:-./lights433}
+SECS=${2:-10}
+RUNS=20
+
+if [ ! -x "$BIN" ]; then
+  echo "Usage: $0 [binary] [seconds]" >&2
+  exit 1
+fi
+
+echo "binary:        $BIN"
+echo "file size:     $(stat -c %s "$BIN") bytes"
+
+# cold start: average over RUNS runs of a one-day plan
+TODAY=$(date +%Y-%m-%d)
+START=$(date +%s%N)
+i=0
+while [ $i -lt $RUNS ]; do
+  "$BIN" plan "$TODAY" "$TODAY" > /dev/null || exit 1
+  i=$((i + 1))
+done
+END=$(date +%s%N)
+echo "startup:       $(( (END - START) / RUNS / 1000 )) us (plan of one day, mean of $RUNS runs)"
+
+# resident memory of the running daemon, simulated
+STATE=$(mktemp -d) || exit 1
+"$BIN" simulate "$STATE" > /dev/null 2>&1 &
+PID=$!
+sleep "$SECS"
+if ! kill -0 $PID 2> /dev/null; then
+  echo "The daemon stopped before the measurement (see $STATE/lights433.log)" >&2
+  exit 1
+fi
+grep -E '^(VmRSS|VmHWM|RssAnon|RssFile|VmData)' /proc/$PID/status | \
+  awk '{ printf "%-14s %s %s\n", $1, $2, $3 }'
+kill $PID
+wait $PID 2> /dev/null
+rm -rf "$STATE"
@@ -0,0 +1,158 @@
+/*
+minutemap.cpp
+
+Per-minute bitmaps of the plan.
+
+minute_compile() takes the plan of a site from plan_days(), the same
+batched calculation as the schedule export, and sets the minutes of
+every on-interval of every switch: a run of bits, whole words at a time.
+A minute counts as on if the switch is on during any part of it. Counts
+over a range handle the two partial words at the ends with masks; the
+words in between go through the vector loop, which has no branches.
+*/
+
+#include "minutemap.h"
+#include <string.h>
+#include <algorithm>
+
+// **********************************************************************
+//      An empty map of days [first, last] at time zone 'tzone'
+// **********************************************************************
+void minute_init(struct minute_map *m, int32_t first, int32_t last, int tzone)
+{
+  m->first   = first;
+  m->t0      = (time_t) first * 86400 - 3600 * (time_t) tzone;
+  m->minutes = std::max<int64_t>(0, (int64_t) last - first + 1) * MM_DAY;
+  m->bits.assign((size_t) (m->minutes + 63) / 64, 0);
+}
+
+// **********************************************************************
+//      Mark [on, off) as on
+// **********************************************************************
+void minute_set(struct minute_map *m, time_t on, time_t off)
+{
+  int64_t lo = std::max<int64_t>(cal_floor_div(on - m->t0, 60), 0);
+  int64_t hi = std::min<int64_t>(-cal_floor_div(m->t0 - off, 60), m->minutes) - 1;   // ceil, then inclusive
+  if (lo > hi)
+    return;
+  size_t a = (size_t) lo >> 6, b = (size_t) hi >> 6;
+  uint64_t first = ~0ull << (lo & 63);
+  uint64_t last  = ~0ull >> (63 - (hi & 63));
+  if (a == b) {
+    m->bits[a] |= first & last;
+    return;
+  }
+  m->bits[a] |= first;
+  for (size_t k = a + 1; k < b; k++)
+    m->bits[k] = ~0ull;
+  m->bits[b] |= last;
+}
+
+// **********************************************************************
+//      The maps of the 7 switches of a site for days [first, last]. The
+//      night of the day before 'first' is included, as it lasts past
+//      midnight. Returns 0.
+// **********************************************************************
+int minute_compile(const struct plan_site *site, int32_t first, int32_t last, struct minute_map *maps)
+{
+  for (int i = 0; i < 7; i++)
+    minute_init(&maps[i], first, last, site->tzone);
+  plan_days(site, first - 1, last, [&](const struct plan_day *days, int n) {
+    for (int k = 0; k < n; k++) {
+      for (int i = 0; i < 7; i++) {
+        if (!(days[k].switches & (1u << i)))
+          continue;
+        for (int j = 0; j < days[k].night[i].n; j++)
+          minute_set(&maps[i], days[k].night[i].on[j], days[k].night[i].off[j]);
+      }
+    }
+  });
+  return 0;
+}
+
+// **********************************************************************
+//      Counting
+// **********************************************************************
+
+// two words, one SIMD register on NEON and SSE2
+typedef uint64_t mm_vec __attribute__((vector_size(16)));
+
+template <int OP, class T> static inline T word_op(T a, T b)
+{
+  if (OP == MM_AND)
+    return a & b;
+  if (OP == MM_XOR)
+    return a ^ b;
+  if (OP == MM_ANDNOT)
+    return a & ~b;
+  return a;
+}
+
+// bits of op(a[k], b[k]) for k in [lo, hi)
+template <int OP> static uint64_t count_words(const uint64_t *a, const uint64_t *b, size_t lo, size_t hi)
+{
+  mm_vec sum = { 0, 0 };
+  size_t k = lo;
+  for (; k + 2 <= hi; k += 2) {
+    mm_vec va, vb;
+    memcpy(&va, a + k, sizeof(va));
+    memcpy(&vb, b + k, sizeof(vb));
+    sum += mm_popcount(word_op<OP>(va, vb));
+  }
+  uint64_t total = sum[0] + sum[1];
+  if (k < hi)
+    total += mm_popcount(word_op<OP>(a[k], b[k]));
+  return total;
+}
+
+template <int OP> static int64_t count_range(const uint64_t *a, const uint64_t *b, int64_t from, int64_t to)
+{
+  size_t lo = (size_t) from >> 6, hi = (size_t) (to - 1) >> 6;
+  uint64_t mlo = ~0ull << (from & 63);
+  uint64_t mhi = ~0ull >> (63 - ((to - 1) & 63));
+  if (lo == hi)
+    return (int64_t) mm_popcount(word_op<OP>(a[lo], b[lo]) & mlo & mhi);
+  uint64_t sum = mm_popcount(word_op<OP>(a[lo], b[lo]) & mlo) + mm_popcount(word_op<OP>(a[hi], b[hi]) & mhi);
+  return (int64_t) (sum + count_words<OP>(a, b, lo + 1, hi));
+}
+
+// **********************************************************************
+//      Minutes in [from, to) of 'a' (MM_COUNT, b is not used), or of a
+//      combination of two maps of the same days (MM_AND, MM_XOR,
+//      MM_ANDNOT)
+// **********************************************************************
+int64_t minute_count(const struct minute_map *a, const struct minute_map *b, int op, int64_t from, int64_t to)
+{
+  from = std::max<int64_t>(from, 0);
+  to   = std::min<int64_t>(to, a->minutes);
+  if (from >= to)
+    return 0;
+  const uint64_t *pa = a->bits.data(), *pb = b ? b->bits.data() : pa;
+  switch (op) {
+  case MM_AND:    return count_range<MM_AND>(pa, pb, from, to);
+  case MM_XOR:    return count_range<MM_XOR>(pa, pb, from, to);
+  case MM_ANDNOT: return count_range<MM_ANDNOT>(pa, pb, from, to);
+  default:        return count_range<MM_COUNT>(pa, pa, from, to);
+  }
+}
+
+// First minute of a day in the map
+int64_t minute_of_day(const struct minute_map *m, int32_t day)
+{
+  return ((int64_t) day - m->first) * MM_DAY;
+}
+
+// **********************************************************************
+//      out = a ^ b: the minutes in which two plans differ
+// **********************************************************************
+void minute_xor(const struct minute_map *a, const struct minute_map *b, struct minute_map *out)
+{
+  out->first   = a->first;
+  out->t0      = a->t0;
+  out->minutes = a->minutes;
+  out->bits.resize(a->bits.size());
+  const uint64_t *pa = a->bits.data(), *pb = b->bits.data();
+  uint64_t *po = out->bits.data();
+  for (size_t k = 0; k < out->bits.size(); k++)
+    po[k] = pa[k] ^ pb[k];
+}
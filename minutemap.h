@@ -0,0 +1,57 @@
+/*
+	minutemap.h
+
+	The plan of a switch as a bitmap with one bit per minute: 525,600
+	bits, 64 kB, for a year. Minute k is the minute from t0 + 60 k, where
+	t0 is midnight (local standard time) of the first day, so the minutes
+	of a day or a month are a range of bits. Questions about a schedule
+	become bit counts over ranges: hours on in a month (a), hours two
+	switches are on together (a & b), and what a change of configuration
+	does (a ^ b, a & ~b). The counting loops work on two words at a time
+	with a branch-free popcount on 128-bit vectors (GCC vector extensions,
+	NEON or SSE2 without intrinsics).
+*/
+#ifndef MINUTEMAP_H
+#define MINUTEMAP_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <vector>
+#include "planexport.h"
+
+#define MM_DAY 1440		// minutes per day
+
+#define MM_COUNT  0		// bits of a
+#define MM_AND    1		// a & b: both on
+#define MM_XOR    2		// a ^ b: changed
+#define MM_ANDNOT 3		// a & ~b: on in a only
+
+struct minute_map {
+  int32_t first;                  // first day (since the epoch)
+  time_t  t0;                     // its midnight, local standard time
+  int64_t minutes;
+  std::vector<uint64_t> bits;
+};
+
+// Bits set in each 64-bit word of x (a word, or a vector of them),
+// without a popcount instruction or table
+template <class T> static inline T mm_popcount(T x)
+{
+  x = x - ((x >> 1) & 0x5555555555555555ull);
+  x = (x & 0x3333333333333333ull) + ((x >> 2) & 0x3333333333333333ull);
+  x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0full;
+  x += x >> 8;
+  x += x >> 16;
+  x += x >> 32;
+  return x & 0x7f;
+}
+
+void    minute_init(struct minute_map *, int32_t, int32_t, int);
+void    minute_set(struct minute_map *, time_t, time_t);
+int     minute_compile(const struct plan_site *, int32_t, int32_t, struct minute_map *);
+int64_t minute_count(const struct minute_map *, const struct minute_map *, int, int64_t, int64_t);
+int64_t minute_of_day(const struct minute_map *, int32_t);
+void    minute_xor(const struct minute_map *, const struct minute_map *, struct minute_map *);
+
+#endif
@@ -0,0 +1,110 @@
+/*
+perfcount.cpp
+
+perf_event_open(2) counters.
+
+Each counter is opened on its own rather than as a group: a group is
+only scheduled when all of its events fit on the PMU at once, and a
+single missing or unsupported event would take the others down with it.
+When there are more events than hardware counters the kernel multiplexes
+them; every read returns the time the event was enabled and the time it
+actually ran, and the count is scaled by their ratio.
+*/
+
+#include "perfcount.h"
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <string.h>
+
+static const struct {
+  uint32_t type;
+  uint64_t config;
+  const char *name;
+} events [PC_COUNTERS] = {
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES,       "cycles" },
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS,     "instructions" },
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS, "branches" },
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES,    "branch-misses" },
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES, "cache-references" },
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES,     "cache-misses" },
+  { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS,      "page-faults" },
+};
+
+// what read() returns with the read_format below
+struct perf_reading {
+  uint64_t value;
+  uint64_t time_enabled;
+  uint64_t time_running;
+};
+
+const char *perf_name(int k)
+{
+  return k >= 0 && k < PC_COUNTERS ? events[k].name : "?";
+}
+
+// **********************************************************************
+//      Open the counters of this thread, stopped. Returns the number
+//      that are available (0: none, e.g. no PMU or not permitted).
+// **********************************************************************
+int perf_open(struct perf_counters *pc)
+{
+  int n = 0;
+  for (int k = 0; k < PC_COUNTERS; k++) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size           = sizeof(attr);
+    attr.type           = events[k].type;
+    attr.config         = events[k].config;
+    attr.disabled       = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+    attr.read_format    = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    pc->fd[k]    = (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+    pc->value[k] = 0;
+    if (pc->fd[k] >= 0)
+      n++;
+  }
+  return n;
+}
+
+void perf_start(struct perf_counters *pc)
+{
+  for (int k = 0; k < PC_COUNTERS; k++) {
+    if (pc->fd[k] < 0)
+      continue;
+    ioctl(pc->fd[k], PERF_EVENT_IOC_RESET, 0);
+    ioctl(pc->fd[k], PERF_EVENT_IOC_ENABLE, 0);
+  }
+}
+
+// **********************************************************************
+//      Stop the counters and read them, scaled for multiplexing
+// **********************************************************************
+void perf_stop(struct perf_counters *pc)
+{
+  for (int k = 0; k < PC_COUNTERS; k++) {
+    if (pc->fd[k] >= 0)
+      ioctl(pc->fd[k], PERF_EVENT_IOC_DISABLE, 0);
+  }
+  for (int k = 0; k < PC_COUNTERS; k++) {
+    struct perf_reading r;
+    pc->value[k] = 0;
+    if (pc->fd[k] < 0 || read(pc->fd[k], &r, sizeof(r)) != (ssize_t) sizeof(r))
+      continue;
+    if (r.time_running > 0 && r.time_running < r.time_enabled)
+      pc->value[k] = (uint64_t) ((double) r.value * r.time_enabled / r.time_running);
+    else
+      pc->value[k] = r.value;
+  }
+}
+
+void perf_close(struct perf_counters *pc)
+{
+  for (int k = 0; k < PC_COUNTERS; k++) {
+    if (pc->fd[k] >= 0)
+      close(pc->fd[k]);
+    pc->fd[k] = -1;
+  }
+}
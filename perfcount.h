@@ -0,0 +1,41 @@
+/*
+	perfcount.h
+
+	Hardware and software event counters of the calling thread, through
+	perf_event_open(2): cycles, instructions, branches and their misses,
+	cache references and misses, page faults. Only user-space events are
+	counted, which an unprivileged process may do with the default
+	kernel.perf_event_paranoid of 2. Counters the CPU, the kernel or a
+	virtual machine does not offer are left out; the others still work.
+*/
+#ifndef PERFCOUNT_H
+#define PERFCOUNT_H
+
+#include <stdint.h>
+
+#define PC_CYCLES        0
+#define PC_INSTRUCTIONS  1
+#define PC_BRANCHES      2
+#define PC_BRANCH_MISSES 3
+#define PC_CACHE_REFS    4
+#define PC_CACHE_MISSES  5
+#define PC_PAGE_FAULTS   6
+#define PC_COUNTERS      7
+
+struct perf_counters {
+  int      fd    [PC_COUNTERS];   // -1 = not available
+  uint64_t value [PC_COUNTERS];   // counts between perf_start() and perf_stop()
+};
+
+int  perf_open(struct perf_counters *);
+void perf_start(struct perf_counters *);
+void perf_stop(struct perf_counters *);
+void perf_close(struct perf_counters *);
+const char *perf_name(int);
+
+inline bool perf_has(const struct perf_counters *pc, int k)
+{
+  return pc->fd[k] >= 0;
+}
+
+#endif
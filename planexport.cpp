@@ -0,0 +1,346 @@
+/*
+planexport.cpp
+
+Batch schedule export.
+
+For every site the dates are taken PLAN_BLOCK_DAYS at a time: one call of
+solar_calc() gives the sunrise and sunset of the whole block,
+then the on/off times of the switches follow with integer arithmetic
+only. AstroCalc4R returns hours of local standard time, so
+  sunrise = day * 86400 - tzone * 3600 + hours * 3600
+is the same instant that calc_sunriseset() finds through mktime(); only
+the off time is a local wall clock time and needs to know about daylight
+saving; an off time before sunset (e.g. 00:30) is the next morning's.
+Daylight saving is that of the host's time zone (localtime_r()), like
+everywhere else in the daemon; read_site() plans a site whose tzone
+is not the host's standard offset in the host's zone.
+The kernel is evaluated at noon of every date. Above the polar circles it
+has no sunrise or sunset (NaN) for part of the year: in the polar night
+both are taken at noon, and in the polar day (plan_day.midnight_sun) only
+switches with an on_rule go on. Rows are formatted by
+hand into a 64 kB buffer, which is written with fwrite() whenever it
+fills up.
+*/
+
+#include "planexport.h"
+#include "solar.h"
+#include "calendar.h"
+#include <math.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <vector>
+
+#define PLAN_BUFFER (1 << 16)
+
+struct plan_writer {
+  FILE *fp;
+  size_t used;
+  char buf [PLAN_BUFFER];
+};
+
+static void flush(struct plan_writer *w)
+{
+  if (w->used > 0)
+    fwrite(w->buf, 1, w->used, w->fp);
+  w->used = 0;
+}
+
+static void put(struct plan_writer *w, const void *data, size_t n)
+{
+  if (w->used + n > PLAN_BUFFER)
+    flush(w);
+  if (n > PLAN_BUFFER) {
+    fwrite(data, 1, n, w->fp);
+    return;
+  }
+  memcpy(w->buf + w->used, data, n);
+  w->used += n;
+}
+
+// decimal digits of v, returns the end of the text
+static char *format_int(char *p, int64_t v)
+{
+  char tmp [24];
+  int n = 0;
+  uint64_t u = v < 0 ? 0 - (uint64_t) v : (uint64_t) v;
+  if (v < 0)
+    *p++ = '-';
+  do {
+    tmp[n++] = '0' + (char) (u % 10);
+    u /= 10;
+  } while (u != 0);
+  while (n > 0)
+    *p++ = tmp[--n];
+  return p;
+}
+
+// **********************************************************************
+//      Parse a date (YYYY-MM-DD); INT32_MIN if it is not one
+// **********************************************************************
+int32_t plan_parse_day(const char *text)
+{
+  int y, m, d;
+  char end;
+  if (sscanf(text, "%d-%d-%d%c", &y, &m, &d, &end) != 3 || m < 1 || m > 12 || d < 1 ||
+      d > cal_days_in_month(y, m))
+    return INT32_MIN;
+  return days_from_civil(y, m, d);
+}
+
+// **********************************************************************
+//    The plan of days [first, last] of a site, PLAN_BLOCK_DAYS at a time:
+//    'fn' is called with every block. Returns the number of days.
+// **********************************************************************
+long plan_days(const struct plan_site *site, int32_t first, int32_t last,
+               const std::function<void(const struct plan_day *, int)> &fn)
+{
+  // inputs and outputs of the solar kernel, one entry per date of a block
+  std::vector<struct solar_input>  sun_in  (PLAN_BLOCK_DAYS);
+  std::vector<struct solar_output> sun_out (PLAN_BLOCK_DAYS);
+  std::vector<struct plan_day>     days    (PLAN_BLOCK_DAYS);
+
+  int tzone = site->tzone;
+  for (struct solar_input &in : sun_in) {
+    in.hour = 12.0;
+    in.lat  = site->lat;
+    in.lon  = site->lon;
+  }
+
+  // the rules of the switches get the sun times of a block, as seconds
+  // after local midnight, and give their on/off times the same way
+  bool rules = false;
+  for (int i = 0; i < 7; i++)
+    rules = rules || !rule_empty(&site->on_rule[i]) || !rule_empty(&site->off_rule[i]);
+  std::vector<int32_t> vars, rule_on, rule_off;
+  std::vector<time_t> wall (PLAN_BLOCK_DAYS);     // local midnight (wall clock)
+  if (rules) {
+    vars.resize(RULE_VARS * PLAN_BLOCK_DAYS);
+    rule_on.resize(7 * PLAN_BLOCK_DAYS);
+    rule_off.resize(7 * PLAN_BLOCK_DAYS);
+  }
+  double sin_lat = sin(site->lat * M_PI / 180), cos_lat = cos(site->lat * M_PI / 180);
+
+  for (int64_t d0 = first; d0 <= last; d0 += PLAN_BLOCK_DAYS) {
+    int n = (int) std::min<int64_t>(PLAN_BLOCK_DAYS, last - d0 + 1);
+    for (int k = 0; k < n; k++) {
+      struct civil_date c = civil_from_days((int32_t) (d0 + k));
+      sun_in[k].year  = c.year;
+      sun_in[k].month = c.month;
+      sun_in[k].day   = c.day;
+      days[k].civil   = c;
+    }
+    // the polynomial kernel (about 1.3x faster, checked by 'lights433 mathcheck')
+    solar_calc(std::span(sun_in).first(n), tzone, std::span(sun_out), true);
+
+    for (int k = 0; k < n; k++) {
+      struct plan_day *pd = &days[k];
+      int32_t date = (int32_t) (d0 + k);
+      time_t midnight = (time_t) date * 86400 - 3600 * (time_t) tzone;   // standard time
+      pd->date = date;
+      double dec  = sun_out[k].declin * M_PI / 180;
+      double rise = sun_out[k].sunrise, set = sun_out[k].sunset;
+      pd->midnight_sun = false;
+      if (!std::isfinite(rise) || !std::isfinite(set)) {
+        // no sunrise or sunset: in the polar night both are at noon, in
+        // the polar day they are 12 hours from noon
+        double c = (sin(-0.83333 * M_PI / 180) - sin_lat * sin(dec)) / (cos_lat * cos(dec));
+        pd->midnight_sun = c < 0;
+        rise = sun_out[k].noon - (pd->midnight_sun ? 12 : 0);
+        set  = sun_out[k].noon + (pd->midnight_sun ? 12 : 0);
+      }
+      pd->rise = midnight + (time_t) (60 * (int64_t) (60 * rise));
+      pd->set  = midnight + (time_t) (60 * (int64_t) (60 * set));
+      time_t t_on = pd->set + 60 * (time_t) site->on_offset;
+
+      // the off time is a wall clock time: one hour earlier in summer
+      struct tm tml;
+      time_t at_noon = midnight + 12 * 3600;
+      localtime_r(&at_noon, &tml);
+      wall[k] = midnight - (tml.tm_isdst > 0 ? 3600 : 0);
+      int offset = random_offset(site->id, -1, date, RANDOM_OFF_TIME, site->off_random);
+      time_t t_off = midnight + 60 * (time_t) (60 * site->off_hour + site->off_min + offset)
+                     - (tml.tm_isdst > 0 ? 3600 : 0);
+      // an off time before sunset is the next morning's
+      if (t_off <= pd->set) {
+        at_noon += 86400;
+        localtime_r(&at_noon, &tml);
+        t_off = midnight + 86400 + 60 * (time_t) (60 * site->off_hour + site->off_min + offset)
+                - (tml.tm_isdst > 0 ? 3600 : 0);
+      }
+      pd->on  = t_on;
+      pd->off = t_off;
+      if (rules) {
+        // civil twilight: the hour angle of the sun 6 degrees below the horizon
+        double c = (cos(96 * M_PI / 180) - sin_lat * sin(dec)) / (cos_lat * cos(dec));
+        double h = acos(std::clamp(c, -1.0, 1.0)) * 12 / M_PI;
+        double hours[RULE_VARS];
+        hours[RULE_SUNRISE] = rise;
+        hours[RULE_SUNSET]  = set;
+        hours[RULE_NOON]    = sun_out[k].noon;
+        hours[RULE_DAWN]    = sun_out[k].noon - h;
+        hours[RULE_DUSK]    = sun_out[k].noon + h;
+        for (int v = 0; v < RULE_VARS; v++)
+          vars[v * PLAN_BLOCK_DAYS + k] = (int32_t) (60 * (int64_t) (60 * hours[v]) + (midnight - wall[k]));
+      }
+    }
+
+    if (rules) {
+      struct rule_dates dates;
+      dates.n     = n;
+      dates.first = (int32_t) d0;
+      dates.site  = site->id;
+      for (int v = 0; v < RULE_VARS; v++)
+        dates.var[v] = &vars[v * PLAN_BLOCK_DAYS];
+      for (int i = 0; i < 7; i++) {
+        dates.sw = i;
+        if (!rule_empty(&site->on_rule[i]))
+          rule_eval(&site->on_rule[i], site->calendar, &dates, &rule_on[i * PLAN_BLOCK_DAYS]);
+        if (!rule_empty(&site->off_rule[i]))
+          rule_eval(&site->off_rule[i], site->calendar, &dates, &rule_off[i * PLAN_BLOCK_DAYS]);
+      }
+    }
+
+    for (int k = 0; k < n; k++) {
+      struct plan_day *pd = &days[k];
+      int32_t date = pd->date;
+      bool vacation = site->vacation ||
+                      (site->vacation_days >= 0 && daycal_test(site->calendar, site->vacation_days, date));
+      pd->switches = 0;
+      for (int i = 0; i < 7; i++) {
+        if (!(site->switches & (1u << i)) || !daycal_test(site->calendar, site->days[i], date))
+          continue;
+        // it does not get dark: only an on_rule switches on
+        if (pd->midnight_sun && rule_empty(&site->on_rule[i]))
+          continue;
+        time_t t_on = pd->on, t_off = pd->off;
+        if (rules) {
+          // no on time on this date: the switch stays off
+          int32_t r_on = rule_on[i * PLAN_BLOCK_DAYS + k], r_off = rule_off[i * PLAN_BLOCK_DAYS + k];
+          if (!rule_empty(&site->on_rule[i]) && r_on == RULE_NONE)
+            continue;
+          if (!rule_empty(&site->on_rule[i]))
+            t_on = wall[k] + r_on;
+          if (!rule_empty(&site->off_rule[i]) && r_off != RULE_NONE)
+            t_off = wall[k] + r_off;
+          // an off time before the on time is the next morning's
+          if (t_off <= t_on)
+            t_off += 86400;
+        }
+        pd->switches |= 1u << i;
+        if (vacation) {
+          vacation_night(site->id, i, date, t_on, t_off, &site->vp, &pd->night[i]);
+        } else {
+          pd->night[i].n      = 1;
+          pd->night[i].on [0] = t_on;
+          pd->night[i].off[0] = t_off;
+        }
+      }
+    }
+    fn(days.data(), n);
+  }
+  return last >= first ? (long) last - first + 1 : 0;
+}
+
+// **********************************************************************
+//    Write the schedule of days [first, last] of all sites to fp.
+//    Returns the number of rows, or -1 if writing failed.
+// **********************************************************************
+long plan_export(FILE *fp, const struct plan_site *sites, int nsites, int32_t first, int32_t last, int format)
+{
+  struct plan_writer *w = new struct plan_writer;
+  w->fp = fp;
+  w->used = 0;
+
+  // binary columns of one block
+  size_t max_rows = (size_t) PLAN_BLOCK_DAYS * 7 * VAC_MAX_SEGMENTS;
+  std::vector<int32_t>  c_day;
+  std::vector<uint16_t> c_site;
+  std::vector<uint8_t>  c_sw;
+  std::vector<int64_t>  c_rise, c_set, c_on, c_off;
+  if (format == PLAN_BINARY) {
+    c_day.reserve(max_rows);  c_site.reserve(max_rows); c_sw.reserve(max_rows);
+    c_rise.reserve(max_rows); c_set.reserve(max_rows);  c_on.reserve(max_rows); c_off.reserve(max_rows);
+    uint32_t version = PLAN_VERSION;
+    put(w, PLAN_MAGIC, 8);
+    put(w, &version, sizeof(version));
+  } else {
+    const char *header = "date,site,switch,sunrise,sunset,on,off\n";
+    put(w, header, strlen(header));
+  }
+
+  long rows = 0;
+  for (int s = 0; s < nsites; s++) {
+    const struct plan_site *site = &sites[s];
+    plan_days(site, first, last, [&](const struct plan_day *days, int n) {
+      for (int k = 0; k < n; k++) {
+        const struct plan_day *pd = &days[k];
+
+        // date and site are the same for all rows of this date
+        char prefix [96];
+        char *p = prefix;
+        if (format == PLAN_CSV) {
+          p = format_int(p, pd->civil.year);
+          *p++ = '-'; *p++ = '0' + pd->civil.month / 10; *p++ = '0' + pd->civil.month % 10;
+          *p++ = '-'; *p++ = '0' + pd->civil.day / 10;   *p++ = '0' + pd->civil.day % 10;
+          *p++ = ',';
+          size_t len = strnlen(site->name, 48);   // quoted, the default name is "lat,lon"
+          *p++ = '"';
+          memcpy(p, site->name, len);
+          p += len;
+          *p++ = '"';
+          *p++ = ',';
+        }
+
+        for (int i = 0; i < 7; i++) {
+          if (!(pd->switches & (1u << i)))
+            continue;
+          const struct switch_night *night = &pd->night[i];
+          for (int j = 0; j < night->n; j++) {
+            if (format == PLAN_BINARY) {
+              c_day.push_back(pd->date);
+              c_site.push_back((uint16_t) s);
+              c_sw.push_back((uint8_t) i);
+              c_rise.push_back(pd->rise);
+              c_set.push_back(pd->set);
+              c_on.push_back(night->on[j]);
+              c_off.push_back(night->off[j]);
+            } else {
+              char line [192];
+              size_t len = p - prefix;
+              memcpy(line, prefix, len);
+              char *q = line + len;
+              *q++ = '1' + i;                  *q++ = ',';
+              q = format_int(q, pd->rise);     *q++ = ',';
+              q = format_int(q, pd->set);      *q++ = ',';
+              q = format_int(q, night->on[j]); *q++ = ',';
+              q = format_int(q, night->off[j]);
+              *q++ = '\n';
+              put(w, line, q - line);
+            }
+            rows++;
+          }
+        }
+      }
+
+      // one binary block per batch of dates
+      if (format == PLAN_BINARY && !c_day.empty()) {
+        uint32_t nrows = (uint32_t) c_day.size();
+        put(w, &nrows, sizeof(nrows));
+        put(w, c_day.data(),  nrows * sizeof(int32_t));
+        put(w, c_site.data(), nrows * sizeof(uint16_t));
+        put(w, c_sw.data(),   nrows * sizeof(uint8_t));
+        put(w, c_rise.data(), nrows * sizeof(int64_t));
+        put(w, c_set.data(),  nrows * sizeof(int64_t));
+        put(w, c_on.data(),   nrows * sizeof(int64_t));
+        put(w, c_off.data(),  nrows * sizeof(int64_t));
+        c_day.clear(); c_site.clear(); c_sw.clear();
+        c_rise.clear(); c_set.clear(); c_on.clear(); c_off.clear();
+      }
+    });
+  }
+  flush(w);
+  delete w;
+  fflush(fp);
+  return ferror(fp) ? -1 : rows;
+}
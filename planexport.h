@@ -0,0 +1,65 @@
+/*
+	planexport.h
+
+	Batch export of the schedule: sunrise, sunset and the on/off times
+	of every controlled switch, for every site and every date of a
+	range, as CSV or as a binary columnar stream. Dates are processed
+	in blocks, so memory use does not depend on the length of the range.
+*/
+#ifndef PLANEXPORT_H
+#define PLANEXPORT_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "vacation.h"
+#include "daycal.h"
+#include "timerule.h"
+#include "calendar.h"
+#include <functional>
+
+#define PLAN_BLOCK_DAYS 1024	// dates per batch of solar calculations
+#define PLAN_CSV        0
+#define PLAN_BINARY     1
+#define PLAN_MAGIC      "L433PLAN"	// binary stream: magic, uint32 version, then blocks
+#define PLAN_VERSION    1
+
+// Binary block: uint32 rows, then the columns, each rows entries long:
+//   int32 day (since the epoch), uint16 site, uint8 switch (0-6),
+//   int64 sunrise, int64 sunset, int64 on, int64 off (seconds since the epoch)
+
+// Everything the schedule of one site depends on
+struct plan_site {
+  const char *name;
+  uint32_t id;                  // site_hash() of the name
+  double   lat, lon;
+  int      tzone;               // hours from GMT, standard time (that of the host)
+  int      on_offset;           // minutes after sunset
+  int      off_hour, off_min;   // local time to switch off
+  int      off_random;          // random minutes added to the off time (0 .. off_random, either sign)
+  unsigned switches;            // controlled switches (bit i = switch i)
+  bool     vacation;
+  struct vacation_params vp;
+  const struct day_calendar *calendar;
+  int      days [7];            // day rule of each switch (-1 = every day)
+  int      vacation_days;       // days of vacation mode besides 'vacation' (-1 = none)
+  struct time_rule on_rule [7]; // on and off time rules of the switches (empty:
+  struct time_rule off_rule [7];// on_offset after sunset, off time of the site)
+};
+
+// The plan of one site and date
+struct plan_day {
+  int32_t  date;                // days since the epoch
+  struct civil_date civil;
+  time_t   rise, set;           // polar night: both at noon; polar day: 12 hours from noon
+  bool     midnight_sun;        // the sun does not set (no switch goes on at sunset)
+  time_t   on, off;             // on and off time of the site (before vacation mode)
+  unsigned switches;            // switches planned on this date
+  struct switch_night night [7];
+};
+
+int32_t plan_parse_day(const char *);
+long    plan_days(const struct plan_site *, int32_t, int32_t,
+                  const std::function<void(const struct plan_day *, int)> &);
+long    plan_export(FILE *, const struct plan_site *, int, int32_t, int32_t, int);
+
+#endif
@@ -0,0 +1,40 @@
+/*
+pulsetrain.cpp 
+
+RCSwitch protocols and pulse trains.
+*/
+
+#include "pulsetrain.h"
+
+const struct rf_protocol rf_protocols[] = {
+  { 350,  1, 31,  1,  3,  3,  1 },    // protocol 1
+  { 650,  1, 10,  1,  2,  2,  1 },    // protocol 2
+  { 100, 30, 71,  4, 11,  9,  6 },    // protocol 3
+  { 380,  1,  6,  1,  3,  3,  1 },    // protocol 4
+  { 500,  6, 14,  1,  2,  2,  1 },    // protocol 5
+};
+const int rf_nprotocols = sizeof(rf_protocols) / sizeof(rf_protocols[0]);
+
+// **********************************************************************
+//      Durations (us) of one frame of 'code': high, low, high, low, ...
+//      As in RCSwitch the data bits come first, MSB first, followed by
+//      the sync pulse. Returns the number of durations.
+// **********************************************************************
+int pulse_train(unsigned long code, int bits, int protocol, uint32_t *durations)
+{
+  const struct rf_protocol *p = &rf_protocols[protocol - 1];
+  int n = 0;
+
+  for (int i = bits - 1; i >= 0; i--) {
+    if ((code >> i) & 1) {
+      durations[n++] = p->one_high  * p->pulse;
+      durations[n++] = p->one_low   * p->pulse;
+    } else {
+      durations[n++] = p->zero_high * p->pulse;
+      durations[n++] = p->zero_low  * p->pulse;
+    }
+  }
+  durations[n++] = p->sync_high * p->pulse;
+  durations[n++] = p->sync_low  * p->pulse;
+  return n;
+}
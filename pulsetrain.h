@@ -0,0 +1,29 @@
+/* 
+	pulsetrain.h
+
+	Pulse timings of the RCSwitch protocols, shared by the transmitter 
+	(to build the pulse train of a code) and the receiver (to decode it).
+*/
+#ifndef PULSETRAIN_H
+#define PULSETRAIN_H
+
+#include <stdint.h>
+
+#define RF_REPEATS   10		// frames per code (RCSwitch default)
+#define RF_MAX_BITS  32
+#define RF_MAX_PULSES (2 * RF_MAX_BITS + 2)
+
+// Timings in multiples of the pulse length (us)
+struct rf_protocol {
+  int pulse;
+  int sync_high, sync_low;
+  int zero_high, zero_low;
+  int one_high,  one_low;
+};
+
+extern const struct rf_protocol rf_protocols[];
+extern const int rf_nprotocols;
+
+int pulse_train(unsigned long, int, int, uint32_t *);
+
+#endif
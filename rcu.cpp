@@ -0,0 +1,126 @@
+/*
+rcu.cpp
+
+Epoch-based reclamation.
+
+A global epoch counts the objects retired so far. A reader stores the
+epoch it sees in its slot when its outermost read section starts, and 0
+when the section ends. Retiring an object first takes it out of view
+(the exchange in rcu_ptr::publish()), then advances the epoch and notes
+the epoch before the advance with the object. Readers that note a later
+epoch started after the exchange, as all operations are sequentially
+consistent, and can only see the new object. So the object can be freed
+as soon as every slot is either 0 or later than its epoch. A reader
+that read the epoch before the advance but stored it only after the
+writer checked the slots loads the pointer after the exchange as well.
+
+Slots are claimed by a thread on its first read section (a compare and
+exchange on the owner flag) and given back when the thread exits.
+Writers serialize on a mutex, which only writers take.
+*/
+
+#include "rcu.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct rcu_slot {
+  std::atomic<uint64_t> epoch;   // epoch at the start of the read section, 0 = not reading
+  std::atomic<bool>     owned;
+  char pad [64 - sizeof(std::atomic<uint64_t>) - sizeof(std::atomic<bool>)];
+};
+
+struct rcu_retired {
+  const void *p;
+  void (*free)(const void *);
+  uint64_t epoch;
+};
+
+static struct rcu_slot slots [RCU_READERS];
+static std::atomic<uint64_t> epoch(1);
+static std::mutex retire_lock;
+static std::vector<struct rcu_retired> retired;
+
+// The slot of this thread, claimed on first use and given back at exit
+struct rcu_thread {
+  int slot  = -1;
+  int depth = 0;
+  ~rcu_thread() {
+    if (slot >= 0)
+      slots[slot].owned.store(false, std::memory_order_release);
+  }
+};
+static thread_local struct rcu_thread self;
+
+static int claim_slot(void)
+{
+  for (bool warned = false; ; ) {
+    for (int i = 0; i < RCU_READERS; i++) {
+      bool free = false;
+      if (!slots[i].owned.load(std::memory_order_relaxed) &&
+          slots[i].owned.compare_exchange_strong(free, true, std::memory_order_acquire))
+        return i;
+    }
+    // more reading threads than slots: wait for one to exit
+    if (!warned)
+      fprintf(stderr, "rcu: more than %d reading threads\n", RCU_READERS);
+    warned = true;
+    std::this_thread::yield();
+  }
+}
+
+// **********************************************************************
+//      Read sections (may be nested)
+// **********************************************************************
+void rcu_read_lock(void)
+{
+  if (self.depth++ > 0)
+    return;
+  if (self.slot < 0)
+    self.slot = claim_slot();
+  slots[self.slot].epoch.store(epoch.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+}
+
+void rcu_read_unlock(void)
+{
+  if (--self.depth > 0)
+    return;
+  slots[self.slot].epoch.store(0, std::memory_order_release);
+}
+
+// **********************************************************************
+//      Free 'p' with 'free' once no reader can see it any more; 'p' must
+//      already be out of view
+// **********************************************************************
+void rcu_retire(const void *p, void (*free)(const void *))
+{
+  std::lock_guard<std::mutex> lock(retire_lock);
+  uint64_t e = epoch.fetch_add(1, std::memory_order_seq_cst);
+  retired.push_back(rcu_retired{p, free, e});
+}
+
+// **********************************************************************
+//      Free the retired objects no reader can see. Returns the number
+//      that are still in use.
+// **********************************************************************
+int rcu_reclaim(void)
+{
+  std::lock_guard<std::mutex> lock(retire_lock);
+  uint64_t oldest = UINT64_MAX;
+  for (int i = 0; i < RCU_READERS; i++) {
+    uint64_t e = slots[i].epoch.load(std::memory_order_seq_cst);
+    if (e != 0 && e < oldest)
+      oldest = e;
+  }
+  size_t kept = 0;
+  for (size_t k = 0; k < retired.size(); k++) {
+    if (retired[k].epoch < oldest)
+      retired[k].free(retired[k].p);
+    else
+      retired[kept++] = retired[k];
+  }
+  retired.resize(kept);
+  return (int) kept;
+}
@@ -0,0 +1,54 @@
+/*
+	rcu.h
+
+	Read-copy-update for data that many threads read and few change:
+	writers build a new object and publish it with one atomic exchange;
+	readers load the pointer between rcu_read_lock() and rcu_read_unlock()
+	and may use the object until then. Neither call blocks, takes a lock
+	or writes to memory shared with other readers: each reading thread
+	has a slot of its own (a cache line), in which it notes the epoch it
+	started reading in. The replaced object is freed once no reader that
+	might still see it is left (epoch-based reclamation); writers never
+	wait for readers either, they leave the object on a list for later.
+*/
+#ifndef RCU_H
+#define RCU_H
+
+#include <atomic>
+
+#define RCU_READERS 64		// threads that can be in a read section at once
+
+void rcu_read_lock(void);
+void rcu_read_unlock(void);
+void rcu_retire(const void *, void (*)(const void *));
+int  rcu_reclaim(void);
+
+// A read section for a scope
+struct rcu_reader {
+  rcu_reader()  { rcu_read_lock(); }
+  ~rcu_reader() { rcu_read_unlock(); }
+  rcu_reader(const rcu_reader &) = delete;
+};
+
+// **********************************************************************
+//      A pointer published by writers and read under rcu_read_lock()
+// **********************************************************************
+template <class T> class rcu_ptr {
+public:
+  rcu_ptr() : p(nullptr) {}
+
+  // only valid until the end of the read section
+  const T *load() const { return p.load(std::memory_order_seq_cst); }
+
+  // replace the object; the old one is deleted when no reader sees it
+  void publish(const T *next) {
+    const T *old = p.exchange(next, std::memory_order_seq_cst);
+    if (old != nullptr)
+      rcu_retire(old, [](const void *q) { delete static_cast<const T *>(q); });
+  }
+
+private:
+  std::atomic<const T *> p;
+};
+
+#endif
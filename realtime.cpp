@@ -0,0 +1,172 @@
+/*
+realtime.cpp 
+
+Real-time transmit mode and jitter self-test.
+
+On an ordinary thread a pulse of 350 us can stretch by a scheduler tick
+whenever something else wants the CPU, and receivers then miss the frame.
+Under SCHED_FIFO, with the pages locked and the thread pinned, the only
+remaining error is the wake-up latency of clock_nanosleep(). rt_calibrate()
+measures that latency, and rt_send() wakes up that much before each edge 
+and spins for the rest, so edges land within a few microseconds.
+*/
+
+#include "realtime.h"
+#include "pulsetrain.h"
+#include <wiringPi.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+
+static int64_t spin_ns = 200000;   // until calibrated: spin for the last 200 us
+
+static inline int64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static inline void sleep_until_ns(int64_t t)
+{
+  struct timespec ts;
+  ts.tv_sec  = t / 1000000000;
+  ts.tv_nsec = t % 1000000000;
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0)
+    ;
+}
+
+// **********************************************************************
+//      Make the calling thread real-time: SCHED_FIFO at 'priority',
+//      pinned to 'cpu' (-1 = any), all memory locked. Returns 0 on
+//      success, or a bit mask of the steps that failed (1 = scheduler,
+//      2 = affinity, 4 = mlockall), e.g. when not running as root.
+// **********************************************************************
+int rt_setup(int priority, int cpu)
+{
+  int failed = 0;
+
+  struct sched_param sp;
+  sp.sched_priority = priority;
+  if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp) != 0)
+    failed |= 1;
+
+  if (cpu >= 0) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+      failed |= 2;
+  }
+
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+    failed |= 4;
+
+  return failed;
+}
+
+// **********************************************************************
+//      Measure how late clock_nanosleep() wakes up and set the spin time
+//      to the 99th percentile of that latency. Returns the spin time (ns).
+// **********************************************************************
+int64_t rt_calibrate(void)
+{
+  const int trials = 200;
+  std::vector<int64_t> late(trials);
+
+  for (int i = 0; i < trials; i++) {
+    int64_t target = now_ns() + 500000;
+    sleep_until_ns(target);
+    late[i] = now_ns() - target;
+  }
+  std::sort(late.begin(), late.end());
+  spin_ns = std::max((int64_t) RT_SPIN_MIN, late[trials * 99 / 100] + RT_SPIN_MIN);
+  return spin_ns;
+}
+
+// **********************************************************************
+//      Send the pulse train 'durations' (n values in us, starting high)
+//      'repeats' times on 'pin'. With 'simulate' the pin is left alone
+//      but the timing is the same. The error of every edge is stored in
+//      'errors' (n * repeats values, may be NULL) and added to 'stats'.
+// **********************************************************************
+int rt_send(int pin, const uint32_t *durations, int n, int repeats, bool simulate, 
+            int32_t *errors, struct jitter_stats *stats)
+{
+  int64_t deadline = now_ns() + spin_ns;   // first edge
+
+  for (int r = 0; r < repeats; r++) {
+    for (int i = 0; i < n; i++) {
+      if (deadline - now_ns() > spin_ns)
+        sleep_until_ns(deadline - spin_ns);
+      int64_t t;
+      while ((t = now_ns()) < deadline)
+        ;
+      if (!simulate)
+        digitalWrite(pin, (i & 1) ? LOW : HIGH);
+
+      int64_t err = t - deadline;
+      if (errors != NULL)
+        errors[r * n + i] = (int32_t) err;
+      if (stats != NULL) {
+        stats->n   += 1;
+        stats->sum += err;
+        stats->max  = std::max(stats->max, err);
+      }
+      deadline += 1000 * (int64_t) durations[i];
+    }
+  }
+  // end of the last low phase
+  sleep_until_ns(deadline);
+  if (!simulate)
+    digitalWrite(pin, LOW);
+  return 0;
+}
+
+// **********************************************************************
+//      Jitter self-test: send 'frames' codes and print the distribution
+//      of the edge and pulse-width errors. Returns 0.
+// **********************************************************************
+int jitter_test(int pin, int frames, unsigned long code, int priority, int cpu)
+{
+  uint32_t durations [RF_MAX_PULSES];
+  int n = pulse_train(code, 24, 1, durations);
+  std::vector<int32_t> errors((size_t) n * RF_REPEATS);
+  std::vector<int32_t> edge, width;
+
+  int failed = rt_setup(priority, cpu);
+  if (failed)
+    printf("warning: real-time setup incomplete (%s%s%s), results show ordinary scheduling\n",
+           failed & 1 ? "SCHED_FIFO " : "", failed & 2 ? "affinity " : "", failed & 4 ? "mlockall" : "");
+  printf("spin before each edge: %lld us\n", (long long) rt_calibrate() / 1000);
+
+  if (pin >= 0)
+    pinMode(pin, OUTPUT);
+  for (int f = 0; f < frames; f++) {
+    rt_send(pin, durations, n, RF_REPEATS, pin < 0, errors.data(), NULL);
+    for (size_t i = 0; i < errors.size(); i++) {
+      edge.push_back(errors[i]);
+      if (i > 0)
+        width.push_back(errors[i] - errors[i-1]);  // error of the pulse before edge i
+    }
+  }
+
+  const char *names[2] = { "edge error ", "pulse width" };
+  std::vector<int32_t> *sets[2] = { &edge, &width };
+  printf("%d frames, %d edges\n", frames * RF_REPEATS, (int) edge.size());
+  printf("              min      p50      p90      p99    p99.9      max   (us)\n");
+  for (int k = 0; k < 2; k++) {
+    std::vector<int32_t> &v = *sets[k];
+    std::sort(v.begin(), v.end());
+    size_t m = v.size() - 1;
+    printf("%s %8.1f %8.1f %8.1f %8.1f %8.1f %8.1f\n", names[k],
+           v[0] / 1000.0, v[m / 2] / 1000.0, v[m * 9 / 10] / 1000.0,
+           v[m * 99 / 100] / 1000.0, v[m * 999 / 1000] / 1000.0, v[m] / 1000.0);
+  }
+  return 0;
+}
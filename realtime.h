@@ -0,0 +1,29 @@
+/* 
+	realtime.h
+
+	Real-time transmit mode. The transmitter thread runs under SCHED_FIFO,
+	pinned to one CPU with its memory locked, and places every edge of the
+	pulse train at an absolute deadline: clock_nanosleep() until shortly
+	before the edge, then a calibrated spin on the monotonic clock.
+*/
+#ifndef REALTIME_H
+#define REALTIME_H
+
+#include <stdint.h>
+
+#define RT_PRIORITY  80		// default SCHED_FIFO priority
+#define RT_SPIN_MIN  20000	// shortest spin before an edge (in ns)
+
+// Edge timing errors of the frames sent so far (in ns)
+struct jitter_stats {
+  long    n;
+  int64_t sum;
+  int64_t max;
+};
+
+int     rt_setup(int, int);
+int64_t rt_calibrate(void);
+int     rt_send(int, const uint32_t *, int, int, bool, int32_t *, struct jitter_stats *);
+int     jitter_test(int, int, unsigned long, int, int);
+
+#endif
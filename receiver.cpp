@@ -0,0 +1,290 @@
+/*
+receiver.cpp 
+
+433 MHz receive and decode path.
+
+The interrupt handler does nothing but read the clock and push the time
+stamp into the ring buffer, so bursts of edges from a noisy band are 
+absorbed without drops. Decoding follows RCSwitch::receiveProtocol(): the
+long low phase of the sync pulse ends a frame, its length gives the pulse
+length, and every following high/low pair is matched against the bit 
+timings of each protocol. A code is passed on once it has been decoded 
+twice in a row, and only once per press of the remote.
+*/
+
+#include "receiver.h"
+#include "pulsetrain.h"
+#include <wiringPi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+#include <chrono>
+
+static struct edge_ring ring;
+static struct rx_decoder decoder;
+static rx_handler handler;
+
+// Code index: open addressing, key = code, value = switch and on/off
+struct code_slot {
+  long code;      // -1 = empty
+  int  sw;
+  bool on;
+};
+static std::vector<struct code_slot> code_index (CODE_INDEX_SIZE);
+
+// **********************************************************************
+//      Ring buffer. Single producer (interrupt), single consumer (decoder).
+// **********************************************************************
+bool ring_push(struct edge_ring *r, uint32_t t)
+{
+  uint32_t head = r->head.load(std::memory_order_relaxed);
+  if (head - r->tail.load(std::memory_order_acquire) == RX_RING_SIZE) {
+    r->dropped.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  r->buf[head & (RX_RING_SIZE - 1)] = t;
+  r->head.store(head + 1, std::memory_order_release);
+  return true;
+}
+
+bool ring_pop(struct edge_ring *r, uint32_t *t)
+{
+  uint32_t tail = r->tail.load(std::memory_order_relaxed);
+  if (tail == r->head.load(std::memory_order_acquire))
+    return false;
+  *t = r->buf[tail & (RX_RING_SIZE - 1)];
+  r->tail.store(tail + 1, std::memory_order_release);
+  return true;
+}
+
+// **********************************************************************
+//      Pulse decoder
+// **********************************************************************
+void decoder_init(struct rx_decoder *d)
+{
+  d->last_edge     = 0;
+  d->count         = 0;
+  d->last_code     = 0;
+  d->last_time     = 0;
+  d->reported_code = 0;
+  d->reported_time = 0;
+}
+
+static bool matches(unsigned int duration, int units, int delay, int tolerance)
+{
+  int expected = units * delay;
+  return abs((int) duration - expected) < tolerance;
+}
+
+// Decode the frame in d->timings (timings[0] is the sync gap before it)
+static bool decode_frame(const struct rx_decoder *d, const struct rf_protocol *p, struct rx_code *out)
+{
+  int delay     = d->timings[0] / p->sync_low;
+  int tolerance = delay * RX_TOLERANCE / 100;
+  unsigned long code = 0;
+
+  for (int i = 1; i < d->count - 1; i += 2) {
+    code <<= 1;
+    if (matches(d->timings[i], p->zero_high, delay, tolerance) && 
+        matches(d->timings[i+1], p->zero_low, delay, tolerance)) {
+      // zero
+    } else if (matches(d->timings[i], p->one_high, delay, tolerance) && 
+               matches(d->timings[i+1], p->one_low, delay, tolerance)) {
+      code |= 1;
+    } else {
+      return false;
+    }
+  }
+  out->code = code;
+  out->bits = (d->count - 1) / 2;
+  return true;
+}
+
+// Feed one edge (timestamp in us). Returns true if a code was accepted.
+bool decoder_edge(struct rx_decoder *d, uint32_t t, struct rx_code *out)
+{
+  unsigned int duration = t - d->last_edge;    // wraps correctly
+  bool accepted = false;
+  d->last_edge = t;
+
+  if (duration > RX_SEPARATION) {
+    // end of a frame: try every protocol on what has been collected
+    if (d->count > 7) {
+      for (int p = 0; p < rf_nprotocols && !accepted; p++) {
+        if (decode_frame(d, &rf_protocols[p], out) && out->code != 0) {
+          out->protocol = p + 1;
+          bool repeat   = out->code == d->last_code && t - d->last_time < RX_HOLDOFF;
+          bool reported = out->code == d->reported_code && t - d->reported_time < RX_HOLDOFF;
+          d->last_code  = out->code;
+          d->last_time  = t;
+          if (repeat && !reported) {
+            d->reported_code = out->code;
+            accepted = true;
+          }
+          if (repeat)
+            d->reported_time = t;
+          break;
+        }
+      }
+    }
+    // this gap is the sync of the next frame
+    d->count = 0;
+    d->timings[d->count++] = duration;
+  } else if (d->count < RX_MAX_CHANGES) {
+    d->timings[d->count++] = duration;
+  } else {
+    d->count = 0;     // too long for a frame: noise
+  }
+  return accepted;
+}
+
+// **********************************************************************
+//      Code index: configured codes -> switch and on/off
+// **********************************************************************
+static unsigned int code_hash(unsigned long code)
+{
+  return (unsigned int) ((code * 2654435761u) >> 8) & (code_index.size() - 1);
+}
+
+static void code_index_add(long code, int sw, bool on)
+{
+  if (code < 0)
+    return;
+  unsigned int h = code_hash(code);
+  while (code_index[h].code >= 0 && code_index[h].code != code)
+    h = (h + 1) & (code_index.size() - 1);
+  code_index[h].code = code;
+  code_index[h].sw   = sw;
+  code_index[h].on   = on;
+}
+
+void code_index_build(const int *code_on, const int *code_off, int n)
+{
+  // at most a quarter full, so probe sequences stay short
+  size_t size = CODE_INDEX_SIZE;
+  while (size < 8 * (size_t) n)
+    size *= 2;
+  code_index.assign(size, code_slot{-1, 0, false});
+  for (int i = 0; i < n; i++) {
+    code_index_add(code_on [i], i, true);
+    code_index_add(code_off[i], i, false);
+  }
+}
+
+bool code_index_find(unsigned long code, int *sw, bool *on)
+{
+  unsigned int h = code_hash(code);
+  while (code_index[h].code >= 0) {
+    if ((unsigned long) code_index[h].code == code) {
+      *sw = code_index[h].sw;
+      *on = code_index[h].on;
+      return true;
+    }
+    h = (h + 1) & (code_index.size() - 1);
+  }
+  return false;
+}
+
+// **********************************************************************
+//      Interrupt handler and decoder thread
+// **********************************************************************
+static void edge_interrupt(void)
+{
+  ring_push(&ring, micros());
+}
+
+static void decoder_thread(void)
+{
+  uint32_t t;
+  struct rx_code c;
+  while (1) {
+    while (ring_pop(&ring, &t)) {
+      if (decoder_edge(&decoder, t, &c))
+        handler(c);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  }
+}
+
+// **********************************************************************
+//      Start receiving on wiringPi pin 'pin'. 'fn' is called from the 
+//      decoder thread for every code received.
+// **********************************************************************
+int receiver_start(int pin, rx_handler fn)
+{
+  handler = fn;
+  decoder_init(&decoder);
+  pinMode(pin, INPUT);
+  if (wiringPiISR(pin, INT_EDGE_BOTH, edge_interrupt) < 0)
+    return 1;
+  std::thread(decoder_thread).detach();
+  return 0;
+}
+
+uint32_t receiver_dropped(void)
+{
+  return ring.dropped.load(std::memory_order_relaxed);
+}
+
+// **********************************************************************
+//      Decode a recorded trace: one edge timestamp (us) per line
+// **********************************************************************
+int receiver_replay(const char *filename, rx_handler fn)
+{
+  FILE *fp = fopen(filename, "r");
+  if (fp == NULL)
+    return 1;
+
+  char line [64];
+  uint32_t t;
+  struct rx_code c;
+  struct rx_decoder d;
+  decoder_init(&d);
+
+  // the edges go through the same ring buffer as live ones
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    if (line[0] == '#')
+      continue;
+    while (!ring_push(&ring, (uint32_t) strtoul(line, NULL, 10))) {
+      ring_pop(&ring, &t);
+      if (decoder_edge(&d, t, &c))
+        fn(c);
+    }
+  }
+  while (ring_pop(&ring, &t)) {
+    if (decoder_edge(&d, t, &c))
+      fn(c);
+  }
+  fclose(fp);
+  return 0;
+}
+
+// **********************************************************************
+//      Record 'seconds' of edges from pin 'pin' into a trace file
+// **********************************************************************
+int receiver_record(int pin, const char *filename, int seconds)
+{
+  FILE *fp = fopen(filename, "w");
+  if (fp == NULL)
+    return 1;
+
+  pinMode(pin, INPUT);
+  if (wiringPiISR(pin, INT_EDGE_BOTH, edge_interrupt) < 0) {
+    fclose(fp);
+    return 1;
+  }
+
+  uint32_t t;
+  auto end = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
+  fprintf(fp, "# lights433 edge trace, wiringPi pin %d\n", pin);
+  while (std::chrono::steady_clock::now() < end) {
+    while (ring_pop(&ring, &t))
+      fprintf(fp, "%u\n", t);
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  }
+  while (ring_pop(&ring, &t))
+    fprintf(fp, "%u\n", t);
+  fclose(fp);
+  return 0;
+}
@@ -0,0 +1,63 @@
+/* 
+	receiver.h
+
+	433 MHz receive path. A GPIO interrupt stores the time of every edge
+	in a lock-free single-producer/single-consumer ring buffer; a decoder
+	thread turns the pulse timings into RCSwitch-compatible codes. Codes
+	are mapped back to the configured on/off codes through a small hash 
+	index, so manual presses on the remote can be mirrored into our state.
+*/
+#ifndef RECEIVER_H
+#define RECEIVER_H
+
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+
+#define RX_RING_SIZE   8192	// edges buffered between interrupt and decoder (power of two)
+#define RX_MAX_CHANGES 67	// timings kept per frame (as in RCSwitch)
+#define RX_SEPARATION  4300	// a gap longer than this (in us) separates frames
+#define RX_TOLERANCE   60	// accepted deviation of a pulse (percent)
+#define RX_HOLDOFF     500000	// repeats of a code within this time (in us) are one press
+#define CODE_INDEX_SIZE 64	// minimum slots in the code index (power of two)
+
+// Edge timestamps (us), written by the interrupt, read by the decoder
+struct edge_ring {
+  uint32_t buf[RX_RING_SIZE];
+  std::atomic<uint32_t> head;     // next slot to write (producer)
+  std::atomic<uint32_t> tail;     // next slot to read (consumer)
+  std::atomic<uint32_t> dropped;  // edges lost because the ring was full
+};
+
+// State of the pulse decoder
+struct rx_decoder {
+  uint32_t      last_edge;
+  unsigned int  timings[RX_MAX_CHANGES];
+  int           count;
+  unsigned long last_code;        // last decoded code, to require a repeat
+  uint32_t      last_time;
+  unsigned long reported_code;    // last code passed on, to suppress repeats
+  uint32_t      reported_time;
+};
+
+// A decoded code
+struct rx_code {
+  unsigned long code;
+  int bits;
+  int protocol;
+};
+
+typedef std::function<void(const struct rx_code &)> rx_handler;
+
+bool ring_push(struct edge_ring *, uint32_t);
+bool ring_pop(struct edge_ring *, uint32_t *);
+void decoder_init(struct rx_decoder *);
+bool decoder_edge(struct rx_decoder *, uint32_t, struct rx_code *);
+void code_index_build(const int *, const int *, int);
+bool code_index_find(unsigned long, int *, bool *);
+int  receiver_start(int, rx_handler);
+uint32_t receiver_dropped(void);
+int  receiver_replay(const char *, rx_handler);
+int  receiver_record(int, const char *, int);
+
+#endif
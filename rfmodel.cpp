@@ -0,0 +1,194 @@
+/*
+rfmodel.cpp
+
+Delivery model and burst schedule of the transmitter.
+
+The channel is a Gilbert-Elliott chain over frame slots. With
+  a = P(good -> bad) = loss / (burst * (1 - loss)),  b = P(bad -> good) = 1 / burst
+the chain is in the bad state a share 'loss' of the time and stays
+there 'burst' frames on average. Two slots d apart are both bad with
+probability loss * Pbb(d), where
+  Pbb(d) = loss + (1 - loss) * (1 - a - b)^d
+so a code whose r frames are d slots apart is missed with probability
+  loss * Pbb(d)^(r-1)
+Sent back to back (d = 1) the frames of one code share the same bursts;
+interleaved with n - 1 other codes (d = n) they are nearly independent,
+and fewer repeats give the same delivery.
+
+rf_simulate() runs the same chain over a concrete schedule, with idle
+slots for gaps, so strategies can be compared on airtime and delivery
+('lights433 airtime').
+*/
+
+#include "rfmodel.h"
+#include "pulsetrain.h"
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+// **********************************************************************
+//      Duration of one frame of 'code' (in us)
+// **********************************************************************
+double rf_frame_time(unsigned long code, int bits, int protocol)
+{
+  uint32_t durations [RF_MAX_PULSES];
+  int n = pulse_train(code, bits, protocol, durations);
+  double t = 0;
+  for (int i = 0; i < n; i++)
+    t += durations[i];
+  return t;
+}
+
+// **********************************************************************
+//      Time (us) the transmitter is keyed up during one frame of 'code':
+//      the high pulses, as it sends nothing during the low ones
+// **********************************************************************
+double rf_on_air(unsigned long code, int bits, int protocol)
+{
+  uint32_t durations [RF_MAX_PULSES];
+  int n = pulse_train(code, bits, protocol, durations);
+  double t = 0;
+  for (int i = 0; i < n; i += 2)
+    t += durations[i];
+  return t;
+}
+
+// **********************************************************************
+//      Probability that all 'repeats' frames of a code are lost when
+//      they are 'spacing' frame slots apart
+// **********************************************************************
+double rf_miss(const struct rf_channel *ch, int repeats, int spacing)
+{
+  double loss  = std::min(std::max(ch->loss, 0.0), 1.0);
+  double burst = std::max(ch->burst, 1.0);
+  if (loss <= 0 || repeats <= 0)
+    return repeats <= 0 ? 1.0 : 0.0;
+  if (loss >= 1)
+    return 1.0;
+  double a = loss / (burst * (1 - loss));
+  double b = 1 / burst;
+  double pbb = loss + (1 - loss) * pow(1 - a - b, std::max(spacing, 1));
+  return loss * pow(pbb, repeats - 1);
+}
+
+// **********************************************************************
+//      Fewest frames per code that reach 'delivery' at 'spacing'
+// **********************************************************************
+int rf_repeats(const struct rf_channel *ch, double delivery, int spacing)
+{
+  int r = 1;
+  while (r < RF_MAX_REPEATS && 1 - rf_miss(ch, r, spacing) < delivery)
+    r++;
+  return r;
+}
+
+// **********************************************************************
+//      Interleave the frames of n codes, round by round: code k is sent
+//      in the first repeats[k] rounds. Writes the code of every frame to
+//      'order' and returns the number of frames.
+// **********************************************************************
+int rf_interleave(const int *repeats, int n, int *order)
+{
+  int rounds = 0, m = 0;
+  for (int k = 0; k < n; k++)
+    rounds = std::max(rounds, repeats[k]);
+  for (int r = 0; r < rounds; r++) {
+    for (int k = 0; k < n; k++) {
+      if (repeats[k] > r)
+        order[m++] = k;
+    }
+  }
+  return m;
+}
+
+// **********************************************************************
+//      Monte Carlo of a schedule: slots[i] is the code sent in slot i
+//      (-1 = idle). Stores the mean probability that a code arrives in
+//      'each' and the probability that all of them arrive in 'all'.
+// **********************************************************************
+void rf_simulate(const struct rf_channel *ch, const int *slots, int nslots, int ncodes, int trials,
+                 uint64_t seed, double *each, double *all)
+{
+  std::mt19937_64 rng(seed);
+  std::uniform_real_distribution<double> u(0.0, 1.0);
+  double loss  = std::min(std::max(ch->loss, 0.0), 1.0);
+  double burst = std::max(ch->burst, 1.0);
+  double a = loss < 1 ? loss / (burst * (1 - loss)) : 1.0;
+  double b = 1 / burst;
+  std::vector<char> got(ncodes);
+  long arrived = 0, complete = 0;
+
+  for (int t = 0; t < trials; t++) {
+    std::fill(got.begin(), got.end(), 0);
+    bool bad = u(rng) < loss;
+    for (int i = 0; i < nslots; i++) {
+      if (i > 0)
+        bad = bad ? u(rng) >= b : u(rng) < a;
+      if (slots[i] >= 0 && !bad)
+        got[slots[i]] = 1;
+    }
+    int n = 0;
+    for (char g : got)
+      n += g;
+    arrived  += n;
+    complete += n == ncodes;
+  }
+  *each = (double) arrived / ((double) trials * ncodes);
+  *all  = (double) complete / trials;
+}
+
+// **********************************************************************
+//      Compare the ways of sending n codes of 'code_bits' bits with
+//      protocol 1: the old fixed scheme (10 frames per code, 5 s apart),
+//      back to back and interleaved. Prints a table, returns 0.
+// **********************************************************************
+static void report_row(const struct rf_channel *ch, const char *name, const std::vector<int> &slots,
+                       int ncodes, int repeats, int spacing, double frame_us, int trials)
+{
+  double each, all;
+  long frames = std::count_if(slots.begin(), slots.end(), [](int s) { return s >= 0; });
+  rf_simulate(ch, slots.data(), (int) slots.size(), ncodes, trials, 20260919, &each, &all);
+  printf("%-22s %4d %6ld %9.0f %9.0f  %9.5f %9.5f %9.5f\n", name, repeats, frames, frames * frame_us / 1000,
+         slots.size() * frame_us / 1000, 1 - rf_miss(ch, repeats, spacing), each, all);
+}
+
+int rf_model_report(const struct rf_channel *ch, double delivery, int ncodes, int code_bits, int trials)
+{
+  double frame_us = rf_frame_time(0xAAAAAA, code_bits, 1);
+  int gap_slots = (int) lround(5000000 / frame_us);
+  std::vector<int> slots;
+
+  printf("channel: %.1f%% of frames lost in bursts of %.1f frames, frame %.1f ms, target %.4f\n",
+         100 * ch->loss, ch->burst, frame_us / 1000, delivery);
+  printf("%d code(s), %d trials\n\n", ncodes, trials);
+  printf("%-22s %4s %6s %9s %9s  %9s %9s %9s\n", "strategy", "rep", "frames", "air (ms)", "time (ms)",
+         "P(model)", "P(code)", "P(all)");
+
+  // what send_code() used to do: RCSwitch's 10 frames, then DELAY
+  for (int k = 0; k < ncodes; k++) {
+    slots.insert(slots.end(), RF_REPEATS, k);
+    if (k < ncodes - 1)
+      slots.insert(slots.end(), gap_slots, -1);
+  }
+  report_row(ch, "fixed 10, 5 s apart", slots, ncodes, RF_REPEATS, 1, frame_us, trials);
+
+  // back to back, as many frames as the model needs at spacing 1
+  int r = rf_repeats(ch, delivery, 1);
+  slots.clear();
+  for (int k = 0; k < ncodes; k++)
+    slots.insert(slots.end(), r, k);
+  report_row(ch, "back to back", slots, ncodes, r, 1, frame_us, trials);
+
+  // interleaved, with a few repeat counts around the adaptive one
+  int ra = rf_repeats(ch, delivery, ncodes);
+  for (int rr = std::max(1, ra - 1); rr <= std::min(RF_MAX_REPEATS, ra + 1); rr++) {
+    std::vector<int> repeats(ncodes, rr);
+    slots.resize((size_t) ncodes * rr);
+    rf_interleave(repeats.data(), ncodes, slots.data());
+    report_row(ch, rr == ra ? "interleaved (adaptive)" : "interleaved", slots, ncodes, rr, ncodes,
+               frame_us, trials);
+  }
+  return 0;
+}
@@ -0,0 +1,36 @@
+/*
+	rfmodel.h
+
+	Delivery model of the 433 MHz link, used to choose how often each
+	frame is repeated. Frames are lost in bursts (another remote, a
+	weather station, a motor starting), modelled as a two-state Markov
+	channel: in the bad state every frame is lost, in the good state none.
+	A code is delivered if any of its frames gets through, so repeats help
+	most when they are spread out: the transmitter interleaves the frames
+	of all codes it has to send, round by round, and the repeat count
+	follows from how far apart the frames of one code end up.
+*/
+#ifndef RFMODEL_H
+#define RFMODEL_H
+
+#include <stdint.h>
+
+#define RF_MAX_REPEATS 20	// most frames sent per code
+#define RF_FRAME_LOSS  0.05	// default share of frames lost
+#define RF_BURST       2.0	// default mean length of a loss burst (frames)
+#define RF_DELIVERY    0.999	// default target probability that a code arrives
+
+struct rf_channel {
+  double loss;    // stationary probability that a frame is lost
+  double burst;   // mean number of frames in a loss burst (>= 1)
+};
+
+double rf_frame_time(unsigned long, int, int);
+double rf_on_air(unsigned long, int, int);
+double rf_miss(const struct rf_channel *, int, int);
+int    rf_repeats(const struct rf_channel *, double, int);
+int    rf_interleave(const int *, int, int *);
+void   rf_simulate(const struct rf_channel *, const int *, int, int, int, uint64_t, double *, double *);
+int    rf_model_report(const struct rf_channel *, double, int, int, int);
+
+#endif
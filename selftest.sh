@@ -0,0 +1,84 @@
+#!/bin/sh
+#
+# selftest.sh - end-to-end checks of a lights433 binary
+#
+# Usage: ./selftest.sh [binary]
+#
+# Runs the daemon and its commands as simulations ('lights433 simulate') in
+# a temporary directory, so it sends nothing and leaves a running lights433
+# and /etc alone. Prints one line per check and exits with 1 if any failed.
+
+BIN=${1:-./lights433}
+FAILED=0
+
+if [ ! -x "$BIN" ]; then
+  echo "Usage: $0 [binary]" >&2
+  exit 1
+fi
+BIN=$(cd "$(dirname "$BIN")" && pwd)/$(basename "$BIN")
+
+# the sites are in New York; daylight saving comes from the host's zone
+TZ=EST5EDT,M3.2.0,M11.1.0
+export TZ
+
+STATE=$(mktemp -d) || exit 1
+trap 'rm -rf "$STATE"' EXIT
+mkdir "$STATE/sites"
+cat > "$STATE/lights433.conf" <<EOF
+[GPIO0]
+pin = 0
+simulate = true
+
+[sites]
+dir = $STATE/sites
+EOF
+
+# site <file> <name> <switch> [latitude]: a site that controls one switch
+site() {
+  {
+    printf '[location]\nsite = %s\nlatitude = %s\nlongitude = -74.01\ntimezone = -5\n' "$2" "${4:-40.71}"
+    printf '[Cycle_01]\non_offset = -15\noff_time = 23:30\n'
+    n=1
+    for i in 01 02 03 04 05 06 ALL; do
+      printf '[switch_%s]\non_code = %d1\noff_code = %d0\n' $i $n $n
+      [ "$i" = "$3" ] || printf 'controlled = false\n'
+      n=$((n + 1))
+    done
+  } > "$STATE/sites/$1"
+}
+
+check() {
+  if [ "$2" = 0 ]; then
+    echo "ok      $1"
+  else
+    echo "FAILED  $1"
+    FAILED=1
+  fi
+}
+
+# Events name their site by its id: after another site file sorts in
+# front of them, the history still credits them to the right site
+site b.conf alpha 01
+site c.conf bravo 02
+"$BIN" simulate "$STATE" > /dev/null 2>&1 &
+PID=$!
+sleep 4
+kill $PID
+wait $PID 2> /dev/null
+site a.conf zulu 03
+"$BIN" simulate "$STATE" history > "$STATE/history.txt" 2>&1
+grep -q 'alpha .*switch_01' "$STATE/history.txt" &&
+  grep -q 'bravo .*switch_02' "$STATE/history.txt" &&
+  ! grep -q -e 'alpha .*switch_0[^1]' -e 'bravo .*switch_0[^2]' -e 'zulu' -e '  ?  ' "$STATE/history.txt"
+check "history names the sites after they were reordered" $?
+
+# Above the polar circle there is no sunrise or sunset for weeks: the plan
+# has no night in the midnight sun and sane times in the polar night
+rm "$STATE"/sites/*
+site polar.conf svalbard 01 78.22
+"$BIN" simulate "$STATE" plan 2026-01-01 2026-12-31 csv > "$STATE/plan.csv" 2>&1 &&
+  awk -F, 'NR > 1 { n++; for (i = 4; i <= 7; i++) if ($i < 1767225600 || $i > 1798934400) bad++ }
+           END { exit bad || n < 200 || n > 280 }' "$STATE/plan.csv"
+check "plan of a site in the polar day and night" $?
+
+exit $FAILED
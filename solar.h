@@ -0,0 +1,56 @@
+/*
+	solar.h
+
+	libsolar: batch interface of the AstroCalc4R solar kernel. One output
+	record per input record, written into memory owned by the caller;
+	nothing is allocated and nothing throws, so the same calls serve a
+	timer loop on the Pi and bulk planning on a server. Build with
+	'make libsolar.a' or 'make libsolar.so'.
+
+	C++:  solar_calc(std::span<const solar_input>, tzone, std::span<solar_output>, fast = false)
+	C:    solar_calc(const solar_input *, n, tzone, fast, solar_output *)
+*/
+#ifndef SOLAR_H
+#define SOLAR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct solar_input {
+  int32_t year, month, day;
+  double  hour;           // local standard time
+  double  lat, lon;       // degrees, north and east positive
+};
+
+struct solar_output {
+  double noon, sunrise, sunset;   // hours of local standard time (NaN: no sunrise/sunset)
+  double azimuth, zenith;         // position of the sun at 'hour' (degrees)
+  double eqtime;                  // equation of time (minutes)
+  double declin;                  // declination (degrees)
+  double daylength;               // hours
+  double par;                     // photosynthetically available radiation (W/m2)
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// 'fast' selects the polynomial kernel (fastmath.h) instead of libm. Returns n.
+size_t solar_calc(const struct solar_input *, size_t, int, int, struct solar_output *);
+
+#ifdef __cplusplus
+}
+#endif
+
+#if __cplusplus >= 202002L
+#include <span>
+
+// Computes min(in.size(), out.size()) records and returns their number.
+inline size_t solar_calc(std::span<const solar_input> in, int tzone, std::span<solar_output> out,
+                         bool fast = false) noexcept
+{
+  return solar_calc(in.data(), in.size() < out.size() ? in.size() : out.size(), tzone, fast ? 1 : 0, out.data());
+}
+#endif
+
+#endif
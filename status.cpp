@@ -0,0 +1,122 @@
+/*
+status.cpp
+
+Shared-memory status block.
+
+The daemon builds the next snapshot in memory of its own and copies it
+into the shared block between two increments of 'seq': the first makes
+it odd, the second even again. A reader loads 'seq', copies the block,
+and loads 'seq' once more; the copy is consistent if both loads saw the
+same even number. The header (magic, version, size) is written once,
+when the block is created, and never under the seqlock.
+*/
+
+#include "status.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stddef.h>
+#include <string.h>
+
+static struct status_block *block = NULL;   // the daemon's (writable) mapping
+
+// what follows the header: everything the seqlock protects
+static const size_t body = offsetof(struct status_block, started);
+
+// **********************************************************************
+//      Create (or take over) the status block in 'file'
+// **********************************************************************
+int status_open(const char *file)
+{
+  int fd = open(file, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (fd < 0)
+    return 1;
+  fchmod(fd, 0644);
+  if (ftruncate(fd, sizeof(struct status_block)) != 0) {
+    close(fd);
+    return 1;
+  }
+  void *p = mmap(NULL, sizeof(struct status_block), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED)
+    return 1;
+
+  block = (struct status_block *) p;
+  if (memcmp(block->magic, STATUS_MAGIC, 8) != 0 || block->version != STATUS_VERSION ||
+      block->size != sizeof(struct status_block)) {
+    memset(p, 0, sizeof(struct status_block));
+    block->version = STATUS_VERSION;
+    block->size    = sizeof(struct status_block);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(block->magic, STATUS_MAGIC, 8);
+  }
+  // an odd number left by a daemon that died while writing
+  uint64_t seq = block->seq.load(std::memory_order_relaxed);
+  block->seq.store(seq + (seq & 1), std::memory_order_release);
+  return 0;
+}
+
+// **********************************************************************
+//      Replace the contents of the block with 'next' (its header and
+//      sequence number are not used). Nothing happens if it is not open.
+// **********************************************************************
+void status_publish(const struct status_block *next)
+{
+  if (block == NULL)
+    return;
+  uint64_t seq = block->seq.load(std::memory_order_relaxed);
+  block->seq.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  memcpy((char *) block + body, (const char *) next + body, sizeof(struct status_block) - body);
+  block->seq.store(seq + 2, std::memory_order_release);
+}
+
+// **********************************************************************
+//      Map the block in 'file' read-only; NULL if there is none (or it
+//      has another layout)
+// **********************************************************************
+const struct status_block *status_map(const char *file)
+{
+  int fd = open(file, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return NULL;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(struct status_block)) {
+    close(fd);
+    return NULL;
+  }
+  void *p = mmap(NULL, sizeof(struct status_block), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED)
+    return NULL;
+  const struct status_block *b = (const struct status_block *) p;
+  if (memcmp(b->magic, STATUS_MAGIC, 8) != 0 || b->version != STATUS_VERSION ||
+      b->size != sizeof(struct status_block)) {
+    munmap(p, sizeof(struct status_block));
+    return NULL;
+  }
+  return b;
+}
+
+// **********************************************************************
+//      Copy a consistent snapshot of 'b' to 'out'. Returns 0, or 1 if
+//      the daemon was writing through every attempt ('out' is then not
+//      valid).
+// **********************************************************************
+int status_read(const struct status_block *b, struct status_block *out)
+{
+  memcpy((void *) out, (const void *) b, offsetof(struct status_block, seq));
+  for (int attempt = 0; attempt < 1000; attempt++) {
+    uint64_t seq = b->seq.load(std::memory_order_acquire);
+    if (seq & 1)
+      continue;
+    memcpy((char *) out + body, (const char *) b + body, sizeof(struct status_block) - body);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (b->seq.load(std::memory_order_relaxed) == seq) {
+      out->seq.store(seq, std::memory_order_relaxed);
+      return 0;
+    }
+  }
+  return 1;
+}
@@ -0,0 +1,77 @@
+/*
+	status.h
+
+	Status block of the daemon in shared memory: per site today's plan
+	and per switch its state, its next planned changes and when a code
+	was last sent for it, plus health counters. The layout is fixed (no
+	pointers, fixed-size fields), so any process can map the file
+	read-only and read it without a system call. The daemon rewrites it
+	under a seqlock: a reader copies the block and retries if the
+	sequence number was odd or changed meanwhile, so it always gets one
+	consistent snapshot, and the daemon never waits for a reader.
+*/
+#ifndef STATUS_H
+#define STATUS_H
+
+#include <stdint.h>
+#include <atomic>
+
+#define STATUS_FILE    "/dev/shm/lights433.status"
+#define STATUS_MAGIC   "L433STAT"
+#define STATUS_VERSION 1
+#define STATUS_SITES   16		// sites in the block (the others are left out)
+#define STATUS_NAME    32		// bytes of a site name, with the terminating 0
+
+struct status_switch {
+  uint8_t  controlled;
+  uint8_t  on;                  // last commanded (or received) state
+  uint8_t  planned;             // on according to the plan
+  uint8_t  overridden;          // set by hand on the remote
+  uint32_t transmitters;        // bit mask
+  int64_t  next_on, next_off;   // next planned changes (0 = none planned)
+  int64_t  last_sent;           // last time a code was sent for it (0 = never)
+  int64_t  last_changed;        // last change of state, sent or received
+};
+
+struct status_site {
+  char     name [STATUS_NAME];
+  int32_t  daynum;              // day of today's plan (days since the epoch)
+  int32_t  planned_until;       // last day of the plan ahead
+  int64_t  t_ontime, t_offtime;
+  struct status_switch sw [7];
+};
+
+struct status_health {
+  uint64_t cycles;              // rounds of the control loops
+  uint64_t codes_sent;
+  uint64_t codes_received;      // presses on the remote
+  uint64_t reloads;             // configurations read again (SIGHUP)
+  uint64_t history_errors;      // events that could not be stored
+  uint64_t rx_dropped;          // receiver edges lost
+};
+
+struct status_block {
+  char     magic [8];
+  uint32_t version;
+  uint32_t size;                // sizeof(struct status_block)
+  std::atomic<uint64_t> seq;    // odd while the daemon writes
+  int64_t  started;             // time the daemon started
+  int64_t  updated;             // time of this snapshot
+  uint32_t pid;
+  uint32_t sites;               // entries used in 'site'
+  struct status_health health;
+  struct status_site site [STATUS_SITES];
+};
+
+static_assert(sizeof(struct status_switch) == 40, "status_switch has a fixed layout");
+static_assert(sizeof(std::atomic<uint64_t>) == 8, "seq is a plain 64-bit word");
+
+// writer (the daemon)
+int  status_open(const char *);
+void status_publish(const struct status_block *);
+
+// readers
+const struct status_block *status_map(const char *);
+int  status_read(const struct status_block *, struct status_block *);
+
+#endif
@@ -0,0 +1,64 @@
+/*
+	suntrack.h
+
+	Incremental position of the sun. Declination and equation of time
+	change by less than half a degree a day, so the tracker computes them
+	once per day (with the AstroCalc4R kernel) and only moves the hour
+	angle, which grows by 15 degrees an hour: a step is a rotation of
+	(cos H, sin H) by a fixed angle, four multiplications and no trig.
+	The position is a unit vector (east, north, up), which per-window
+	rules can test with a dot product; angles are only needed for display.
+*/
+#ifndef SUNTRACK_H
+#define SUNTRACK_H
+
+#include <stdint.h>
+#include <time.h>
+
+#define SUN_STEP 5		// seconds between positions in the daemon
+
+struct sun_vector {
+  double east, north, up;
+};
+
+struct sun_tracker {
+  double  lat, lon;       // degrees
+  int     tzone;          // hours from UTC (standard time)
+  int     step;           // seconds per sun_track_step()
+  int32_t day;            // local day of the per-day terms (days since 1970)
+  double  sin_lat, cos_lat;
+  double  sin_dec, cos_dec;   // declination
+  double  eqtime;             // equation of time (minutes)
+  time_t  t;                  // time of the current position
+  double  c, s;               // cos and sin of the hour angle at t
+  double  cd, sd;             // cos and sin of the hour angle of one step
+};
+
+// A window or facade: lit when the sun is in front of it and above 'horizon'
+struct facade {
+  double east, north;     // outward normal
+  double sin_horizon;     // sin of the elevation of what is in front (trees, houses)
+};
+
+void   sun_track_init(struct sun_tracker *, double, double, int, int);
+void   sun_track_seek(struct sun_tracker *, time_t);
+void   sun_track_step(struct sun_tracker *);
+void   sun_track_advance(struct sun_tracker *, time_t);
+struct sun_vector sun_track_vector(const struct sun_tracker *);
+double sun_azimuth(const struct sun_vector *);
+double sun_elevation(const struct sun_vector *);
+void   facade_init(struct facade *, double, double);
+int    sun_check(const struct sun_tracker *, time_t, int);
+
+// Afternoon: the hour angle is positive
+inline bool sun_track_afternoon(const struct sun_tracker *tr)
+{
+  return tr->s > 0;
+}
+
+inline bool facade_lit(const struct facade *f, const struct sun_vector *v)
+{
+  return v->up > f->sin_horizon && v->east * f->east + v->north * f->north > 0;
+}
+
+#endif
@@ -0,0 +1,356 @@
+/*
+timerule.cpp
+
+Time rule expressions.
+
+The parser is recursive descent over the text of one alternative and
+writes the program in postfix order as it goes, keeping count of the
+stack depth; there is no tree. Evaluation keeps one array of n values
+per stack entry, so every instruction is a plain loop over the dates of
+the block that the compiler can vectorize. The day rule of an
+alternative is tested per date only where no earlier alternative held.
+*/
+
+#include "timerule.h"
+#include "vacation.h"
+#include <ctype.h>
+#include <string.h>
+#include <algorithm>
+
+static const char *var_names[RULE_VARS] = { "sunrise", "sunset", "noon", "civil_dawn", "civil_dusk" };
+
+struct rule_parser {
+  const char *p;
+  struct rule_alt *alt;
+  int depth;                // current stack depth
+  int draws;                // rand() calls so far
+  std::string error;
+};
+
+static void skip_space(struct rule_parser *rp)
+{
+  while (isspace((unsigned char) *rp->p))
+    rp->p++;
+}
+
+static int fail(struct rule_parser *rp, const char *what)
+{
+  if (rp->error.empty())
+    rp->error = std::string(what) + " at '" + rp->p + "'";
+  return 1;
+}
+
+static void emit(struct rule_parser *rp, int op, int n, int32_t arg, int pushed)
+{
+  rp->alt->code.push_back(rule_op{(uint8_t) op, (uint8_t) n, 0, arg});
+  rp->depth += pushed;
+  rp->alt->depth = std::max(rp->alt->depth, rp->depth);
+}
+
+static int parse_expr(struct rule_parser *);
+
+// a time of day (HH:MM[:SS]) or a duration (1h30m, 15m, 90s)
+static int parse_number(struct rule_parser *rp)
+{
+  const char *start = rp->p;
+  long v = strtol(rp->p, (char **) &rp->p, 10);
+  if (*rp->p == ':') {
+    long m = strtol(rp->p + 1, (char **) &rp->p, 10), sec = 0;
+    if (*rp->p == ':')
+      sec = strtol(rp->p + 1, (char **) &rp->p, 10);
+    if (v > 48 || m > 59 || sec > 59) {
+      rp->p = start;
+      return fail(rp, "bad time of day");
+    }
+    emit(rp, RULE_CONST, 0, (int32_t) (3600 * v + 60 * m + sec), 1);
+    return 0;
+  }
+  long total = 0;
+  while (1) {
+    char unit = (char) tolower((unsigned char) *rp->p);
+    if (v == 0 && total == 0 && !isalnum((unsigned char) unit))
+      break;                // a plain 0 needs no unit
+    if (unit != 'h' && unit != 'm' && unit != 's') {
+      rp->p = start;
+      return fail(rp, "duration needs a unit (h, m or s)");
+    }
+    rp->p++;
+    total += v * (unit == 'h' ? 3600 : unit == 'm' ? 60 : 1);
+    if (!isdigit((unsigned char) *rp->p))
+      break;
+    v = strtol(rp->p, (char **) &rp->p, 10);
+  }
+  if (total > 7 * 86400)
+    return fail(rp, "duration too long");
+  emit(rp, RULE_CONST, 0, (int32_t) total, 1);
+  return 0;
+}
+
+// the arguments of a function up to ')'; returns their number, or -1
+static int parse_args(struct rule_parser *rp)
+{
+  int n = 0;
+  skip_space(rp);
+  if (*rp->p++ != '(') {
+    rp->p--;
+    fail(rp, "expected '('");
+    return -1;
+  }
+  while (1) {
+    if (parse_expr(rp) != 0)
+      return -1;
+    n++;
+    skip_space(rp);
+    if (*rp->p == ',') {
+      rp->p++;
+      continue;
+    }
+    if (*rp->p == ')') {
+      rp->p++;
+      return n;
+    }
+    fail(rp, "expected ',' or ')'");
+    return -1;
+  }
+}
+
+static int parse_primary(struct rule_parser *rp)
+{
+  skip_space(rp);
+  if (*rp->p == '-') {
+    rp->p++;
+    if (parse_primary(rp) != 0)
+      return 1;
+    emit(rp, RULE_NEG, 0, 0, 0);
+    return 0;
+  }
+  if (*rp->p == '(') {
+    rp->p++;
+    if (parse_expr(rp) != 0)
+      return 1;
+    skip_space(rp);
+    if (*rp->p != ')')
+      return fail(rp, "expected ')'");
+    rp->p++;
+    return 0;
+  }
+  if (isdigit((unsigned char) *rp->p))
+    return parse_number(rp);
+
+  const char *start = rp->p;
+  while (isalnum((unsigned char) *rp->p) || *rp->p == '_')
+    rp->p++;
+  std::string word(start, rp->p - start);
+  for (int v = 0; v < RULE_VARS; v++) {
+    if (word == var_names[v]) {
+      emit(rp, RULE_VAR, 0, v, 1);
+      return 0;
+    }
+  }
+  if (word == "min" || word == "max") {
+    int n = parse_args(rp);
+    if (n < 0)
+      return 1;
+    if (n > 255)
+      return fail(rp, "too many arguments");
+    if (n > 1)
+      emit(rp, word == "min" ? RULE_MIN : RULE_MAX, n, 0, 1 - n);
+    return 0;
+  }
+  if (word == "rand") {
+    if (parse_args(rp) != 2)
+      return fail(rp, "rand() takes two arguments");
+    emit(rp, RULE_RAND, 0, rp->draws++, -1);
+    return 0;
+  }
+  rp->p = start;
+  return fail(rp, word.empty() ? "expected a time, a duration or a name" : "unknown name");
+}
+
+static int parse_expr(struct rule_parser *rp)
+{
+  if (parse_primary(rp) != 0)
+    return 1;
+  while (1) {
+    skip_space(rp);
+    if (*rp->p != '+' && *rp->p != '-')
+      return 0;
+    int op = *rp->p++ == '+' ? RULE_ADD : RULE_SUB;
+    if (parse_primary(rp) != 0)
+      return 1;
+    emit(rp, op, 0, 0, -1);
+  }
+}
+
+// **********************************************************************
+//      Compile 'text' into 'r'. Day rules named after 'on' are looked up
+//      (or added) in 'cal'. Random draws use streams from 'stream' on.
+//      Returns 0, or 1 with a message in 'error'.
+// **********************************************************************
+int rule_compile(struct time_rule *r, const std::string &text, uint32_t stream, struct day_calendar *cal,
+                 std::string *error)
+{
+  r->text   = text;
+  r->stream = stream;
+  r->alts.clear();
+  struct rule_parser rp;
+  rp.draws = 0;
+
+  size_t begin = 0;
+  while (begin <= text.size()) {
+    size_t end = text.find(';', begin);
+    if (end == std::string::npos)
+      end = text.size();
+    std::string part = text.substr(begin, end - begin);
+    begin = end + 1;
+    if (part.find_first_not_of(" \t") == std::string::npos)
+      continue;
+
+    r->alts.push_back(rule_alt{-1, 0, {}});
+    rp.alt   = &r->alts.back();
+    rp.p     = part.c_str();
+    rp.depth = 0;
+    if (parse_expr(&rp) != 0) {
+      *error = rp.error;
+      return 1;
+    }
+    skip_space(&rp);
+    if (strncmp(rp.p, "on", 2) == 0 && isspace((unsigned char) rp.p[2])) {
+      std::string days(rp.p + 3);
+      days.erase(0, days.find_first_not_of(" \t"));
+      days.erase(days.find_last_not_of(" \t") + 1);
+      rp.alt->days = daycal_rule(cal, days);
+      if (rp.alt->days < 0) {
+        *error = "bad day rule '" + days + "'";
+        return 1;
+      }
+    } else if (*rp.p != '\0') {
+      fail(&rp, "unexpected text");
+      *error = rp.error;
+      return 1;
+    }
+    if (rp.alt->depth > RULE_STACK) {
+      *error = "expression nested too deeply";
+      return 1;
+    }
+  }
+  if (r->alts.empty()) {
+    *error = "empty rule";
+    return 1;
+  }
+  return 0;
+}
+
+// **********************************************************************
+//      The value of rule 'r' on every date of 'dates' (RULE_NONE where
+//      none of its alternatives holds)
+// **********************************************************************
+void rule_eval(const struct time_rule *r, const struct day_calendar *cal, const struct rule_dates *dates,
+               int32_t *out)
+{
+  int n = dates->n;
+  std::fill(out, out + n, RULE_NONE);
+  int left = n;
+  std::vector<int32_t> stack;
+
+  for (const struct rule_alt &alt : r->alts) {
+    if (left == 0)
+      break;
+    // stack entry j is at(j)[0 .. n-1]
+    stack.resize((size_t) alt.depth * n);
+    auto at = [&](int j) { return stack.data() + (size_t) j * n; };
+    int sp = 0;
+    for (const struct rule_op &op : alt.code) {
+      switch (op.op) {
+      case RULE_CONST:
+        std::fill(at(sp), at(sp) + n, op.arg);
+        sp++;
+        break;
+      case RULE_VAR:
+        std::copy(dates->var[op.arg], dates->var[op.arg] + n, at(sp));
+        sp++;
+        break;
+      case RULE_ADD:
+      case RULE_SUB: {
+        int32_t *a = at(sp - 2);
+        const int32_t *b = at(sp - 1);
+        if (op.op == RULE_ADD)
+          for (int k = 0; k < n; k++)
+            a[k] += b[k];
+        else
+          for (int k = 0; k < n; k++)
+            a[k] -= b[k];
+        sp--;
+        break;
+      }
+      case RULE_NEG: {
+        int32_t *a = at(sp - 1);
+        for (int k = 0; k < n; k++)
+          a[k] = -a[k];
+        break;
+      }
+      case RULE_MIN:
+      case RULE_MAX: {
+        int32_t *a = at(sp - op.n);
+        for (int j = sp - op.n + 1; j < sp; j++) {
+          const int32_t *b = at(j);
+          if (op.op == RULE_MIN)
+            for (int k = 0; k < n; k++)
+              a[k] = std::min(a[k], b[k]);
+          else
+            for (int k = 0; k < n; k++)
+              a[k] = std::max(a[k], b[k]);
+        }
+        sp -= op.n - 1;
+        break;
+      }
+      case RULE_RAND: {
+        int32_t *lo = at(sp - 2);
+        const int32_t *hi = at(sp - 1);
+        for (int k = 0; k < n; k++) {
+          if (hi[k] > lo[k])
+            lo[k] += (int32_t) random_uniform(dates->site, dates->sw, dates->first + k, r->stream + op.arg, 0,
+                                              (uint32_t) (hi[k] - lo[k]));
+        }
+        sp--;
+        break;
+      }
+      }
+    }
+    const int32_t *value = at(0);
+    for (int k = 0; k < n; k++) {
+      if (out[k] == RULE_NONE && daycal_test(cal, alt.days, dates->first + k)) {
+        out[k] = value[k];
+        left--;
+      }
+    }
+  }
+}
+
+// **********************************************************************
+//      The program of a rule as text, one instruction per line
+// **********************************************************************
+std::string rule_listing(const struct time_rule *r)
+{
+  const char *names[] = { "const", "var", "add", "sub", "neg", "min", "max", "rand" };
+  std::string text;
+  char line [96];
+  for (const struct rule_alt &alt : r->alts) {
+    snprintf(line, sizeof(line), "  alternative, days rule %d, stack %d\n", alt.days, alt.depth);
+    text += line;
+    for (const struct rule_op &op : alt.code) {
+      if (op.op == RULE_CONST)
+        snprintf(line, sizeof(line), "    %-6s %d\n", names[op.op], op.arg);
+      else if (op.op == RULE_VAR)
+        snprintf(line, sizeof(line), "    %-6s %s\n", names[op.op], var_names[op.arg]);
+      else if (op.op == RULE_MIN || op.op == RULE_MAX)
+        snprintf(line, sizeof(line), "    %-6s %d\n", names[op.op], op.n);
+      else if (op.op == RULE_RAND)
+        snprintf(line, sizeof(line), "    %-6s stream %u\n", names[op.op], r->stream + op.arg);
+      else
+        snprintf(line, sizeof(line), "    %s\n", names[op.op]);
+      text += line;
+    }
+  }
+  return text;
+}
@@ -0,0 +1,93 @@
+/*
+	timerule.h
+
+	On and off time rules of a switch: expressions over the sun times of
+	the date and times of day, e.g.
+
+		max(sunset - 15m, 17:00)
+		min(sunrise, 06:30) on weekdays
+		civil_dusk + rand(0, 20m)
+		07:00 on weekend; 06:15
+
+	Values are seconds after local (wall clock) midnight of the date.
+	Terms are times of day (HH:MM or HH:MM:SS), durations with a unit
+	(15m, 2h, 1h30m, 90s), the variables sunrise, sunset, noon,
+	civil_dawn and civil_dusk, +, -, min(...), max(...) and rand(lo, hi)
+	(whole seconds, the same for a given site, switch and date; a plain 0
+	needs no unit). An expression may be followed by 'on' and a day rule
+	(a name from the [calendar] section, or terms like mon-fri);
+	alternatives are separated by ';' and the first whose days hold
+	applies.
+
+	A rule is compiled once into a small stack program. It is evaluated
+	for a whole block of dates at a time, one instruction over every
+	date before the next, so a year of a switch costs a few passes over
+	arrays of integers.
+*/
+#ifndef TIMERULE_H
+#define TIMERULE_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "daycal.h"
+
+#define RULE_NONE  INT32_MIN	// no alternative holds on the date
+#define RULE_STACK 16		// deepest nesting of an expression
+
+// Variables
+#define RULE_SUNRISE 0
+#define RULE_SUNSET  1
+#define RULE_NOON    2
+#define RULE_DAWN    3		// civil dawn: the sun 6 degrees below the horizon
+#define RULE_DUSK    4
+#define RULE_VARS    5
+
+// Instructions
+#define RULE_CONST 0		// push arg (seconds)
+#define RULE_VAR   1		// push variable arg
+#define RULE_ADD   2
+#define RULE_SUB   3
+#define RULE_NEG   4
+#define RULE_MIN   5		// of the top n
+#define RULE_MAX   6
+#define RULE_RAND  7		// uniform in [lo, hi] of the top two, draw arg
+
+struct rule_op {
+  uint8_t  op;
+  uint8_t  n;
+  uint16_t reserved;
+  int32_t  arg;
+};
+
+struct rule_alt {
+  int days;                         // day rule (-1 = every day)
+  int depth;                        // stack entries needed
+  std::vector<struct rule_op> code;
+};
+
+struct time_rule {
+  std::string text;
+  uint32_t stream;                  // random stream of the first rand() (see random_uniform())
+  std::vector<struct rule_alt> alts;   // none: no rule
+};
+
+// A block of consecutive dates to evaluate rules for
+struct rule_dates {
+  int      n;
+  int32_t  first;                   // day of entry 0
+  uint32_t site;                    // site_hash() of the site, and the switch,
+  int      sw;                      // for rand()
+  const int32_t *var [RULE_VARS];   // seconds after local midnight, per date
+};
+
+int rule_compile(struct time_rule *, const std::string &, uint32_t, struct day_calendar *, std::string *);
+void rule_eval(const struct time_rule *, const struct day_calendar *, const struct rule_dates *, int32_t *);
+std::string rule_listing(const struct time_rule *);
+
+inline bool rule_empty(const struct time_rule *r)
+{
+  return r->alts.empty();
+}
+
+#endif
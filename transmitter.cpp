@@ -0,0 +1,243 @@
+/*
+transmitter.cpp 
+
+Transmit dispatcher. One worker thread per transmitter waits for a code,
+gives the other codes of the same event TX_COLLECT ms to arrive, and 
+sends all of them in one burst with send_codes(), which interleaves their
+frames. Completion is reported through the frames' callbacks. The gap 
+after a burst (two frame lengths unless configured) applies per pin, so
+a building with several transmitters switches several times faster.
+
+Before a burst the worker checks the duty-cycle budget of the pin with
+the on-air time of every frame (the high pulses of its pulse train).
+Urgent codes are sent at once if they fit, with fewer frames if that 
+makes them fit, and otherwise as soon as the budget allows. Codes that
+are not urgent queue up behind them and only use airtime beyond a
+reserve of DUTY_RESERVE percent, so a bulk operation cannot use up the
+budget of the next planned change.
+*/
+
+#include "lights433.h"
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+static struct transmitter *transmitters [MAX_TRANSMITTERS];
+static int ntransmitters = 0;
+
+// **********************************************************************
+//      Add a transmitter. Returns its index, or -1 if there are too many.
+// **********************************************************************
+int transmitter_add(const std::string &name, int pin, bool simulate)
+{
+  if (ntransmitters == MAX_TRANSMITTERS)
+    return -1;
+  struct transmitter *tx = new transmitter;
+  tx->name     = name;
+  tx->pin      = pin;
+  tx->simulate = simulate;
+  tx->delay    = DELAY;
+  tx->repeats  = 0;
+  tx->channel  = rf_channel{RF_FRAME_LOSS, RF_BURST};
+  tx->delivery = RF_DELIVERY;
+  duty_init(&tx->duty, DUTY_CYCLE, DUTY_WINDOW);
+  tx->realtime = false;
+  tx->priority = RT_PRIORITY;
+  tx->cpu      = -1;
+  tx->jitter   = jitter_stats{0, 0, 0};
+  transmitters[ntransmitters] = tx;
+  return ntransmitters++;
+}
+
+int transmitter_count(void)
+{
+  return ntransmitters;
+}
+
+int transmitter_find(const std::string &name)
+{
+  for (int i = 0; i < ntransmitters; i++) {
+    if (strcasecmp(transmitters[i]->name.c_str(), name.c_str()) == 0)
+      return i;
+  }
+  return -1;
+}
+
+struct transmitter *transmitter_get(int i)
+{
+  return transmitters[i];
+}
+
+// Bit mask of all transmitters
+unsigned int transmitter_all(void)
+{
+  return ntransmitters == 32 ? 0xFFFFFFFF : (1u << ntransmitters) - 1;
+}
+
+// **********************************************************************
+//      Frames per code for a burst of the first n pending codes, and the
+//      on-air time (us) of that burst
+// **********************************************************************
+static int64_t burst_air(struct transmitter *tx, const std::vector<struct tx_frame> &pending, int n,
+                         std::vector<int> &repeats)
+{
+  int auto_repeats = tx->repeats > 0 ? tx->repeats : rf_repeats(&tx->channel, tx->delivery, n);
+  double air = 0;
+  repeats.resize(n);
+  for (int k = 0; k < n; k++) {
+    repeats[k] = pending[k].repeats > 0 ? pending[k].repeats : auto_repeats;
+    air += repeats[k] * rf_on_air(pending[k].code, 24, 1);
+  }
+  return (int64_t) air;
+}
+
+// **********************************************************************
+//      Choose the next burst: the urgent codes and as many of the others
+//      as the budget allows. Fills in the codes, their frames and the 
+//      on-air time and returns 0, or returns how long (us) to wait if 
+//      nothing can be sent yet.
+// **********************************************************************
+static int64_t plan_burst(struct transmitter *tx, const std::vector<struct tx_frame> &pending,
+                          std::vector<int> &codes, std::vector<int> &repeats, int64_t *air)
+{
+  char buffer [CHARSIZE];     // character buffer for output
+  int64_t now     = duty_now();
+  int64_t avail   = duty_available(&tx->duty, now);
+  int64_t reserve = tx->duty.limit * DUTY_RESERVE / 100;
+  int nurgent = 0;
+  while (nurgent < (int) pending.size() && pending[nurgent].urgent)
+    nurgent++;
+
+  // the most codes that fit: the others only above the reserve
+  int n = (int) pending.size();
+  for ( ; n > nurgent; n--) {
+    *air = burst_air(tx, pending, n, repeats);
+    if (*air <= avail - reserve)
+      break;
+  }
+
+  if (n == nurgent && nurgent == 0) {
+    // only codes that can wait: until the first one fits
+    *air = burst_air(tx, pending, 1, repeats);
+    int64_t wait = duty_wait(&tx->duty, now, *air + reserve);
+    if (wait < 0)
+      wait = duty_wait(&tx->duty, now, *air);
+    if (wait > 0) {
+      std::sprintf (buffer, "   Deferring %d code(s) for %d s to keep the duty cycle (%s)", (int) pending.size(),
+                    (int) (wait / 1000000), tx->name.c_str());
+      logthis(buffer);
+      return wait;
+    }
+    if (wait < 0) {
+      std::sprintf (buffer, "   Code %d exceeds the duty cycle of %s, sending anyway", pending[0].code, 
+                    tx->name.c_str());
+      logthis(buffer);
+    }
+    n = 1;
+  } else if (n == nurgent) {
+    // urgent codes: fewer frames rather than later
+    *air = burst_air(tx, pending, n, repeats);
+    int most = *std::max_element(repeats.begin(), repeats.end());
+    while (*air > avail && most > 1) {
+      most--;
+      *air = 0;
+      for (int k = 0; k < n; k++) {
+        repeats[k] = std::min(repeats[k], most);
+        *air += (int64_t) (repeats[k] * rf_on_air(pending[k].code, 24, 1));
+      }
+    }
+    int64_t wait = duty_wait(&tx->duty, now, *air);
+    if (wait > 0) {
+      std::sprintf (buffer, "   Waiting %d s for airtime to send %d code(s) (%s)", (int) (wait / 1000000), n,
+                    tx->name.c_str());
+      logthis(buffer);
+      return wait;
+    }
+    if (wait < 0) {
+      std::sprintf (buffer, "   %d code(s) exceed the duty cycle of %s, sending anyway", n, tx->name.c_str());
+      logthis(buffer);
+    }
+  }
+
+  codes.resize(n);
+  for (int k = 0; k < n; k++)
+    codes[k] = pending[k].code;
+  return 0;
+}
+
+// **********************************************************************
+//      Worker thread of one transmitter
+// **********************************************************************
+static void transmitter_worker(struct transmitter *tx)
+{
+  char buffer [CHARSIZE];     // character buffer for output
+
+  if (tx->realtime) {
+    int failed = rt_setup(tx->priority, tx->cpu);
+    int64_t spin = rt_calibrate();
+    std::sprintf (buffer, "- %s: real-time mode%s, spinning %d us before each edge", tx->name.c_str(),
+                  failed ? " (incomplete, are we root?)" : "", (int) (spin / 1000));
+    logthis(buffer);
+  }
+
+  std::vector<struct tx_frame> pending;    // waiting for airtime, urgent ones first
+  while (1) {
+    {
+      std::unique_lock<std::mutex> guard(tx->lock);
+      if (pending.empty())
+        tx->cv.wait(guard, [tx] { return !tx->queue.empty(); });
+    }
+    // the switches of one event are queued within microseconds
+    std::this_thread::sleep_for(std::chrono::milliseconds(TX_COLLECT));
+    {
+      std::lock_guard<std::mutex> guard(tx->lock);
+      while (!tx->queue.empty()) {
+        pending.push_back(std::move(tx->queue.front()));
+        tx->queue.pop_front();
+      }
+    }
+    std::stable_partition(pending.begin(), pending.end(), [](const struct tx_frame &f) { return f.urgent; });
+
+    std::vector<int> codes, repeats;
+    int64_t air = 0;
+    int64_t wait = plan_burst(tx, pending, codes, repeats, &air);
+    if (wait > 0) {
+      // nothing fits: wait for airtime, or for an urgent code
+      std::unique_lock<std::mutex> guard(tx->lock);
+      tx->cv.wait_for(guard, std::chrono::microseconds(wait), [tx] { return !tx->queue.empty(); });
+      continue;
+    }
+    int n = (int) codes.size();
+    send_codes(tx, codes.data(), repeats.data(), n);
+    duty_charge(&tx->duty, duty_now(), air);
+    for (int k = 0; k < n; k++)
+      pending[k].done();
+    pending.erase(pending.begin(), pending.begin() + n);
+
+    int gap = tx->delay >= 0 ? tx->delay : (int) (TX_GAP_FRAMES * rf_frame_time(codes[0], 24, 1) / 1000);
+    std::this_thread::sleep_for(std::chrono::milliseconds(gap));
+  }
+}
+
+// **********************************************************************
+//      Set up the pins and start one worker per transmitter
+// **********************************************************************
+void transmitter_start(void)
+{
+  for (int i = 0; i < ntransmitters; i++) {
+    if (!transmitters[i]->simulate)
+      transmitters[i]->rc.enableTransmit(transmitters[i]->pin);
+    std::thread(transmitter_worker, transmitters[i]).detach();
+  }
+}
+
+// **********************************************************************
+//      Queue a frame on transmitter i. 'done' runs on its worker thread.
+// **********************************************************************
+void transmitter_queue(int i, int code, int repeats, bool urgent, std::function<void()> done)
+{
+  struct transmitter *tx = transmitters[i];
+  std::lock_guard<std::mutex> guard(tx->lock);
+  tx->queue.push_back(tx_frame{code, repeats, urgent, std::move(done)});
+  tx->cv.notify_one();
+}
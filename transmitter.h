@@ -0,0 +1,62 @@
+/* 
+	transmitter.h
+
+	433 MHz transmitters. Every [GPIO*] section of the configuration file
+	defines one transmitter. Each transmitter has its own queue and worker
+	thread. The codes queued on a pin at about the same time go out in
+	one burst, their frames interleaved (see rfmodel.h); bursts on the
+	same pin are 'delay' ms apart, while different pins transmit in 
+	parallel. Every transmitter keeps to its duty cycle (dutycycle.h):
+	urgent codes go first, the others wait until there is airtime to 
+	spare.
+*/
+#ifndef TRANSMITTER_H
+#define TRANSMITTER_H
+
+#include <string>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include "dutycycle.h"
+
+#define MAX_TRANSMITTERS 32	// transmitters are addressed by bit masks
+#define TX_COLLECT       5	// ms to wait for more codes before a burst
+#define TX_GAP_FRAMES    2	// default gap after a burst (in frames)
+
+// A frame waiting to be sent, and what to do once it has been sent
+struct tx_frame {
+  int code;
+  int repeats;            // frames to send (0 = the transmitter's)
+  bool urgent;            // false: may wait for airtime (e.g. the sweep at start)
+  std::function<void()> done;
+};
+
+struct transmitter {
+  std::string name;       // name of the section, e.g. "GPIO0"
+  int  pin;               // wiringPi pin 
+  bool simulate;          // log frames instead of driving the pin
+  int  delay;             // gap after a burst (in ms, -1 = TX_GAP_FRAMES frames)
+  int  repeats;           // frames per code (0 = as many as the channel model needs)
+  struct rf_channel channel;  // loss model of the link
+  double delivery;        // target probability that a code arrives
+  struct duty_budget duty;    // airtime of the last window
+  bool realtime;          // send from a SCHED_FIFO thread with calibrated timing
+  int  priority;          // SCHED_FIFO priority in real-time mode
+  int  cpu;               // CPU to pin the thread to in real-time mode (-1 = any)
+  struct jitter_stats jitter;
+  RCSwitch rc;
+  std::mutex lock;
+  std::condition_variable cv;
+  std::deque<struct tx_frame> queue;
+};
+
+int  transmitter_add(const std::string &, int, bool);
+int  transmitter_count(void);
+int  transmitter_find(const std::string &);
+struct transmitter *transmitter_get(int);
+unsigned int transmitter_all(void);
+void transmitter_start(void);
+void transmitter_queue(int, int, int, bool, std::function<void()>);
+
+#endif
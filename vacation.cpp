@@ -0,0 +1,136 @@
+/*
+vacation.cpp 
+
+Vacation mode occupancy simulation.
+
+Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3",
+SC11) maps a 128-bit counter and a 64-bit key to four 32-bit random words
+with ten rounds of multiply/xor. The key is (site, switch), the counter is
+(day, draw, stream, 0), so every draw is independent of all others and no
+generator state needs to be stored, reseeded or replayed.
+*/
+
+#include "vacation.h"
+#include <algorithm>
+
+#define PHILOX_M0 0xD2511F53u
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u
+#define PHILOX_W1 0xBB67AE85u
+
+// **********************************************************************
+//      FNV-1a hash of the site name, used as part of the generator key
+// **********************************************************************
+uint32_t site_hash(const char *name)
+{
+  uint32_t h = 2166136261u;
+  while (*name) {
+    h ^= (uint8_t) *name++;
+    h *= 16777619u;
+  }
+  return h;
+}
+
+// **********************************************************************
+//      Philox4x32-10
+// **********************************************************************
+void philox4x32(const uint32_t ctr[4], const uint32_t key[2], uint32_t out[4])
+{
+  uint32_t c0 = ctr[0], c1 = ctr[1], c2 = ctr[2], c3 = ctr[3];
+  uint32_t k0 = key[0], k1 = key[1];
+
+  for (int round = 0; round < 10; round++) {
+    uint64_t p0 = (uint64_t) PHILOX_M0 * c0;
+    uint64_t p1 = (uint64_t) PHILOX_M1 * c2;
+    uint32_t n0 = (uint32_t) (p1 >> 32) ^ c1 ^ k0;
+    uint32_t n2 = (uint32_t) (p0 >> 32) ^ c3 ^ k1;
+    c0 = n0; c1 = (uint32_t) p1; c2 = n2; c3 = (uint32_t) p0;
+    k0 += PHILOX_W0;
+    k1 += PHILOX_W1;
+  }
+  out[0] = c0; out[1] = c1; out[2] = c2; out[3] = c3;
+}
+
+// **********************************************************************
+//      Uniform integer in [lo, hi] for (site, switch, day) in stream
+//      'stream' (one of the RANDOM_* streams)
+// **********************************************************************
+uint32_t random_uniform(uint32_t site, int sw, int32_t day, uint32_t stream, uint32_t lo, uint32_t hi)
+{
+  uint32_t ctr[4] = { (uint32_t) day, 0, stream, 0 };
+  uint32_t key[2] = { site, (uint32_t) sw };
+  uint32_t r[4];
+  philox4x32(ctr, key, r);
+  return lo + (uint32_t) (((uint64_t) r[0] * ((uint64_t) hi - lo + 1)) >> 32);
+}
+
+// **********************************************************************
+//      Uniform offset between 0 and 'range' (both included) of (site,
+//      switch, day) in stream 'stream'; negative if 'range' is
+// **********************************************************************
+int random_offset(uint32_t site, int sw, int32_t day, uint32_t stream, int range)
+{
+  int r = (int) random_uniform(site, sw, day, stream, 0, (uint32_t) std::abs(range));
+  return range < 0 ? -r : r;
+}
+
+// **********************************************************************
+//      On-intervals of switch 'sw' for the night of 'day', given the
+//      planned on/off times of that night
+// **********************************************************************
+void vacation_night(uint32_t site, int sw, int32_t day, time_t t_on, time_t t_off,
+                    const struct vacation_params *vp, struct switch_night *night)
+{
+  uint32_t ctr[4] = { (uint32_t) day, 0, RANDOM_VACATION, 0 };
+  uint32_t key[2] = { site, (uint32_t) sw };
+  uint32_t r[4];
+  uint32_t breaks[2 * (VAC_MAX_SEGMENTS - 1)];
+
+  // draw 0: jitter of the on and off times, and the number of breaks
+  philox4x32(ctr, key, r);
+  int span_on  = 2 * vp->on_jitter + 1;
+  int span_off = 2 * vp->off_jitter + 1;
+  time_t on  = t_on  + 60 * ((int) (((uint64_t) r[0] * span_on)  >> 32) - vp->on_jitter);
+  time_t off = t_off + 60 * ((int) (((uint64_t) r[1] * span_off) >> 32) - vp->off_jitter);
+  int nbreaks = std::min((int) (((uint64_t) r[2] * (vp->breaks + 1)) >> 32), VAC_MAX_SEGMENTS - 1);
+
+  night->n = 0;
+  if (off <= on)
+    return;
+
+  // draws 1..: start and length of every break
+  for (int b = 0; b < nbreaks; b++) {
+    ctr[1] = 1 + b;
+    philox4x32(ctr, key, r);
+    time_t start = on + (time_t) (((uint64_t) r[0] * (uint64_t) (off - on)) >> 32);
+    int len = vp->break_min + (int) (((uint64_t) r[1] * (vp->break_max - vp->break_min + 1)) >> 32);
+    breaks[2*b]   = (uint32_t) (start - on);
+    breaks[2*b+1] = (uint32_t) (60 * len);
+  }
+
+  // sort breaks by start time (at most three, so insertion sort)
+  for (int b = 1; b < nbreaks; b++) {
+    for (int k = b; k > 0 && breaks[2*k] < breaks[2*(k-1)]; k--) {
+      std::swap(breaks[2*k],   breaks[2*(k-1)]);
+      std::swap(breaks[2*k+1], breaks[2*(k-1)+1]);
+    }
+  }
+
+  // cut the breaks out of [on, off)
+  time_t t = on;
+  for (int b = 0; b < nbreaks; b++) {
+    time_t bstart = on + breaks[2*b];
+    time_t bend   = bstart + breaks[2*b+1];
+    if (bstart > t) {
+      night->on [night->n] = t;
+      night->off[night->n] = bstart;
+      night->n++;
+    }
+    t = std::max(t, bend);
+  }
+  if (off > t) {
+    night->on [night->n] = t;
+    night->off[night->n] = off;
+    night->n++;
+  }
+}
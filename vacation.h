@@ -0,0 +1,45 @@
+/* 
+	vacation.h
+
+	Vacation mode: realistic, reproducible on/off sequences for every 
+	switch. Random numbers come from the counter-based Philox4x32-10
+	generator keyed by (site, switch, day), so any night's plan can be
+	regenerated exactly, in any order and without keeping state.
+*/
+#ifndef VACATION_H
+#define VACATION_H
+
+#include <stdint.h>
+#include <time.h>
+
+#define VAC_MAX_SEGMENTS 4	// maximum number of on-intervals per switch and night
+
+// Random streams (counter word 2): each use of the generator has its own
+#define RANDOM_VACATION 0	// vacation_night()
+#define RANDOM_OFF_TIME 1	// offset of the off time (off_offset)
+#define RANDOM_RULES    0x100	// rand() in time rules, 0x100 streams per rule
+
+// On-intervals [on, off) of one switch during one night
+struct switch_night {
+  int    n;
+  time_t on [VAC_MAX_SEGMENTS];
+  time_t off[VAC_MAX_SEGMENTS];
+};
+
+// Parameters of the occupancy simulation (all in minutes)
+struct vacation_params {
+  int on_jitter;     // on time is moved by up to +/- on_jitter
+  int off_jitter;    // off time is moved by up to +/- off_jitter
+  int breaks;        // maximum number of times a light goes off and on again
+  int break_min;     // shortest break
+  int break_max;     // longest break
+};
+
+uint32_t site_hash(const char *);
+void     philox4x32(const uint32_t ctr[4], const uint32_t key[2], uint32_t out[4]);
+uint32_t random_uniform(uint32_t, int, int32_t, uint32_t, uint32_t, uint32_t);
+int      random_offset(uint32_t, int, int32_t, uint32_t, int);
+void     vacation_night(uint32_t, int, int32_t, time_t, time_t, 
+                        const struct vacation_params *, struct switch_night *);
+
+#endif